@@ -0,0 +1,77 @@
+/* Scratch arena, see arena.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "linker_debug.h"
+
+#define DL_ARENA_MAX		(256 * 1024)
+#define DL_ARENA_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+
+struct dl_arena_chunk
+{
+	struct dl_arena_chunk *prev;
+	size_t size;
+	double data[1];		/* aligned for anything */
+};
+
+void dl_arena_init(struct dl_arena *a)
+{
+	memset(a, 0, sizeof(*a));
+}
+
+/* Chunks grow with the arena, up to DL_ARENA_MAX, so that a load takes
+ * only a few of them; larger requests get a chunk of their own size.
+ */
+void *dl_arena_alloc(struct dl_arena *a, size_t size)
+{
+	struct dl_arena_chunk *c;
+	size_t csize;
+	void *p;
+
+	size = DL_ARENA_ALIGN(size ? size : 1);
+	if (size > a->left) {
+		csize = a->total < DL_ARENA_CHUNK ? DL_ARENA_CHUNK : a->total;
+		if (csize > DL_ARENA_MAX)
+			csize = DL_ARENA_MAX;
+		if (csize < size)
+			csize = size;
+		c = malloc(offsetof(struct dl_arena_chunk, data) + csize);
+		if (c == NULL) {
+			ERROR("malloc failed!\n");
+			return NULL;
+		}
+		c->prev = a->chunks;
+		c->size = csize;
+		a->chunks = c;
+		a->next = (char *)c->data;
+		a->left = csize;
+		a->total += csize;
+	}
+	p = a->next;
+	a->next += size;
+	a->left -= size;
+	return p;
+}
+
+void *dl_arena_calloc(struct dl_arena *a, size_t n, size_t size)
+{
+	void *p = dl_arena_alloc(a, n * size);
+
+	if (p)
+		memset(p, 0, n * size);
+	return p;
+}
+
+void dl_arena_free(struct dl_arena *a)
+{
+	struct dl_arena_chunk *c, *prev;
+
+	TRACE("releasing %lu bytes of load scratch\n", (unsigned long)a->total);
+	for (c = a->chunks; c; c = prev) {
+		prev = c->prev;
+		free(c);
+	}
+	memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,29 @@
+/* Scratch arena
+ *
+ * Allocations are carved out of a list of chunks and are all released
+ * at once by dl_arena_free(); there is no freeing of single allocations.
+ * Used for everything a load needs only until the module is linked.
+ */
+#ifndef _LINKER_ARENA_H_
+#define _LINKER_ARENA_H_
+
+#include <stddef.h>
+
+#define DL_ARENA_CHUNK	4096
+
+struct dl_arena_chunk;
+
+struct dl_arena
+{
+	struct dl_arena_chunk *chunks;
+	char *next;
+	size_t left;
+	size_t total;		/* bytes allocated from the system */
+};
+
+void dl_arena_init(struct dl_arena *a);
+void *dl_arena_alloc(struct dl_arena *a, size_t size);
+void *dl_arena_calloc(struct dl_arena *a, size_t n, size_t size);
+void dl_arena_free(struct dl_arena *a);
+
+#endif
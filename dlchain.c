@@ -0,0 +1,57 @@
+/* Chained hash table, see dlchain.h
+ */
+#include <stdlib.h>
+
+#include "dlchain.h"
+
+#define CHAIN_MIN	256	/* buckets to start with */
+
+/* Double the buckets once there are more entries than buckets; a failure
+ * only leaves the chains longer.
+ */
+static void chain_grow(struct dl_chain *c)
+{
+	struct dl_chain_link **nb, *l, *next;
+	unsigned i, n = c->nbuckets ? 2 * c->nbuckets : CHAIN_MIN;
+
+	nb = calloc(n, sizeof(*nb));
+	if (nb == NULL)
+		return;
+	for (i = 0; i < c->nbuckets; i++) {
+		for (l = c->buckets[i]; l; l = next) {
+			next = l->next;
+			l->next = nb[l->hash & (n - 1)];
+			nb[l->hash & (n - 1)] = l;
+		}
+	}
+	free(c->buckets);
+	c->buckets = nb;
+	c->nbuckets = n;
+}
+
+/* l->hash set; -1 if there are no buckets to put it in */
+int dl_chain_add(struct dl_chain *c, struct dl_chain_link *l)
+{
+	struct dl_chain_link **head;
+
+	if (c->count >= c->nbuckets)
+		chain_grow(c);
+	if (c->nbuckets == 0)
+		return -1;
+	head = &c->buckets[l->hash & (c->nbuckets - 1)];
+	l->next = *head;
+	*head = l;
+	c->count++;
+	return 0;
+}
+
+void dl_chain_remove(struct dl_chain *c, struct dl_chain_link *l)
+{
+	struct dl_chain_link **link;
+
+	for (link = &c->buckets[l->hash & (c->nbuckets - 1)]; *link != l;
+			link = &(*link)->next)
+		;
+	*link = l->next;
+	c->count--;
+}
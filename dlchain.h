@@ -0,0 +1,36 @@
+/* Chained hash table
+ *
+ * The pools of dlmerge.c and dlfold.c keep their entries in one of these.
+ * Entries start with a struct dl_chain_link, are allocated by the caller
+ * and never move; the buckets double as entries are added.  There is no
+ * locking here, callers hold their own lock.
+ */
+#ifndef _LINKER_DLCHAIN_H_
+#define _LINKER_DLCHAIN_H_
+
+#include <stdint.h>
+
+struct dl_chain_link
+{
+	struct dl_chain_link *next;
+	uint32_t hash;
+};
+
+struct dl_chain
+{
+	struct dl_chain_link **buckets;
+	unsigned nbuckets;	/* a power of 2 */
+	unsigned count;
+};
+
+/* The first entry of the chain hash is on, the rest follow by next */
+static inline struct dl_chain_link *
+dl_chain_first(const struct dl_chain *c, uint32_t hash)
+{
+	return c->nbuckets ? c->buckets[hash & (c->nbuckets - 1)] : NULL;
+}
+
+int dl_chain_add(struct dl_chain *c, struct dl_chain_link *l);
+void dl_chain_remove(struct dl_chain *c, struct dl_chain_link *l);
+
+#endif
@@ -13,10 +13,18 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include "cexplock.h"
+#include <stdlib.h>
+#include <string.h>
+
 #include "dlfcn.h"
+#include "dlfold.h"
+#include "dlmerge.h"
+#include "dlrcu.h"
+#include "dlwork.h"
 #include "linker.h"
+#include "prelink.h"
 
+#define SYSMAPFILE	"sym.map"
 #define SYSSYMFILE	"sym.map.gz"
 /* This file hijacks the symbols stubbed out in libdl.so. */
 
@@ -36,36 +44,319 @@ static const char *dl_errors[] = {
     [DL_ERR_SYMBOL_NOT_GLOBAL] = "Symbol is not global",
 };
 
+/* per thread, where the target has thread local storage */
+#ifdef DL_RCU
+static __thread int dl_last_err = DL_SUCCESS;
+#else
 static int dl_last_err = DL_SUCCESS;
+#endif
 
 #define likely(expr)   __builtin_expect (expr, 1)
 #define unlikely(expr) __builtin_expect (expr, 0)
 
-static CexpLock dl_lock;
-
-void *dlopen(const char *filename, int flag) 
+static void dl_init(void)
 {
-	soinfo *ret;
 	static int initialized = 0;
 
 	if (!initialized) {
-		cexpLockCreate(&dl_lock);
-		__linker_init(SYSSYMFILE);
+		dl_rcu_init();
+		dl_fold_init();
+		dl_merge_init();
+		__linker_init(SYSMAPFILE, SYSSYMFILE);
 		initialized = 1;
 	}
-	
-	cexpLock(dl_lock);
+}
+
+/* With RTLD_DEFER the module is only registered, and loaded when one of
+ * its functions is first called through dlsym(), see open_plugin().
+ * Where calls cannot go through stubs it is loaded right away.
+ */
+void *dlopen(const char *filename, int flag) 
+{
+	soinfo *ret;
+
+	dl_init();
+	dl_write_lock();
+
+#ifdef DL_LAZY
+	if (flag & RTLD_DEFER) {
+		void *handle = open_plugin(filename);
 
-	ret = find_library(filename);
+		if (unlikely(handle == NULL))
+			dl_last_err = DL_ERR_CANNOT_FIND_LIBRARY;
+		linker_unlock();
+		return handle;
+	}
+#endif
+	ret = find_library(filename, flag);
 	if (unlikely(ret == NULL)) {
 		dl_last_err = DL_ERR_CANNOT_FIND_LIBRARY;
 	} else {
 		ret->refcount++;
 	}
-	cexpUnlock(dl_lock);
+	linker_unlock();
 	return ret;
 }
 
+/* Like dlopen(), with the object in memory rather than in a file.  name
+ * identifies the module, buf need not stay around once loaded.
+ */
+void *dlopen_mem(const char *name, const void *buf, size_t len, int flag)
+{
+	soinfo *ret;
+
+	dl_init();
+	dl_write_lock();
+
+	ret = find_library_mem(name, buf, len, flag);
+	if (unlikely(ret == NULL)) {
+		dl_last_err = DL_ERR_CANNOT_FIND_LIBRARY;
+	} else {
+		ret->refcount++;
+	}
+	linker_unlock();
+	return ret;
+}
+
+struct dl_batch
+{
+	int flag;
+	const char **names;
+	struct dl_load **lds;
+};
+
+static void dl_prepare_one(void *arg, unsigned i)
+{
+	struct dl_batch *b = arg;
+
+	if (b->names[i])
+		b->lds[i] = prepare_library(b->names[i], b->flag);
+}
+
+/* Load several modules, reading and parsing them in parallel, and what
+ * they need, see dlautoload().  Returns 0 with every handle set, or -1
+ * with none loaded.
+ */
+int dlopen_many(const char **filenames, int n, int flag, void **handles)
+{
+	struct dl_batch b;
+	struct dl_load **todo = NULL, **extra = NULL, **deps, **more;
+	soinfo **linked = NULL, **grown;
+	int i, j, ntodo = 0, ret = -1;
+	unsigned k, m, nextra = 0;
+
+	if (n <= 0)
+		return 0;
+	dl_init();
+	b.flag = flag;
+	b.names = calloc(n, sizeof(*b.names));
+	b.lds = calloc(n, sizeof(*b.lds));
+	todo = malloc(n * sizeof(*todo));
+	linked = malloc(n * sizeof(*linked));
+	if (!b.names || !b.lds || !todo || !linked)
+		goto out;
+
+	/* only what is not loaded yet, and each module once */
+	dl_write_lock();
+	for (i = 0; i < n; i++) {
+		handles[i] = find_loaded_library(filenames[i]);
+		if (handles[i])
+			continue;
+		for (j = 0; j < i; j++) {
+			if (same_library(filenames[j], filenames[i]))
+				break;
+		}
+		if (j == i)
+			b.names[i] = filenames[i];
+	}
+	dl_write_unlock();
+
+	dl_parallel(n, dl_prepare_one, &b);
+
+	for (i = 0; i < n; i++) {
+		if (!b.lds[i] || !(deps = prepare_deps(b.lds[i], flag, &m)))
+			continue;
+		more = realloc(extra, (nextra + m) * sizeof(*extra));
+		if (more) {
+			extra = more;
+			for (k = 1; k < m; k++)
+				extra[nextra++] = deps[k];
+		} else {
+			for (k = 1; k < m; k++)
+				discard_library(deps[k]);
+		}
+		free(deps);
+	}
+	if (nextra) {
+		more = realloc(todo, (n + nextra) * sizeof(*todo));
+		if (more)
+			todo = more;
+		grown = realloc(linked, (n + nextra) * sizeof(*linked));
+		if (grown)
+			linked = grown;
+		if (!more || !grown)
+			goto out;
+	}
+
+	dl_write_lock();
+	for (i = 0; i < n; i++) {
+		if (handles[i]) {
+			/* unless it was closed in the meantime */
+			handles[i] = find_loaded_library(filenames[i]);
+			if (!handles[i])
+				goto unlock;
+			continue;
+		}
+		if (!b.names[i])
+			continue;
+		if (!b.lds[i])
+			goto unlock;
+		/* loaded by someone else in the meantime */
+		handles[i] = find_loaded_library(b.names[i]);
+		if (handles[i]) {
+			discard_library(b.lds[i]);
+		} else {
+			todo[ntodo++] = b.lds[i];
+		}
+		b.lds[i] = NULL;
+	}
+	/* unless loaded or in the batch already */
+	for (k = 0; k < nextra; k++)
+		todo[ntodo + k] = extra[k];
+	ntodo = drop_loaded(todo, ntodo, ntodo + nextra);
+	nextra = 0;
+	if (link_libraries(todo, ntodo, linked) < 0) {
+		ntodo = 0;
+		goto unlock;
+	}
+	for (i = 0, j = 0; i < n; i++) {
+		if (b.names[i] && !handles[i])
+			handles[i] = linked[j++];
+		else if (!handles[i])
+			handles[i] = find_loaded_library(filenames[i]);
+		((soinfo *)handles[i])->refcount++;
+	}
+	ntodo = 0;
+	ret = 0;
+unlock:
+	linker_unlock();
+
+out:
+	/* loads not handed to link_libraries() */
+	for (i = 0; i < ntodo; i++)
+		discard_library(todo[i]);
+	for (k = 0; k < nextra; k++)
+		discard_library(extra[k]);
+	for (i = 0; b.lds && i < n; i++) {
+		if (b.lds[i])
+			discard_library(b.lds[i]);
+	}
+	if (ret < 0) {
+		dl_last_err = DL_ERR_CANNOT_FIND_LIBRARY;
+		for (i = 0; i < n; i++)
+			handles[i] = NULL;
+	}
+	free(extra);
+	free(linked);
+	free(todo);
+	free(b.lds);
+	free(b.names);
+	return ret;
+}
+
+/* Keep relocated images in dir for later loads of the same objects, see
+ * prelink.h; NULL turns the cache off.  Best called before loading.
+ */
+int dlprelink(const char *dir)
+{
+#ifdef DL_PRELINK
+	int ret;
+
+	dl_init();
+	dl_write_lock();
+	ret = linker_prelink(dir);
+	dl_write_unlock();
+	return ret;
+#else
+	return -1;
+#endif
+}
+
+/* Set how module images are laid out from now on, see layout_image();
+ * returns the previous flags.
+ */
+int dllayout(int flags)
+{
+	int ret;
+
+	dl_init();
+	dl_write_lock();
+	ret = linker_layout(flags);
+	dl_write_unlock();
+	return ret;
+}
+
+/* Lay the text of modules loaded from now on out after the profile in
+ * file, a list of hot functions; NULL drops it.  See order_sections().
+ */
+int dlprofile(const char *file)
+{
+	int ret;
+
+	dl_init();
+	dl_write_lock();
+	ret = linker_profile(file);
+	dl_write_unlock();
+	return ret;
+}
+
+/* Index the global symbols of the objects in dir; from now on a module
+ * missing one of them loads the object defining it first, and so does
+ * dlsym(RTLD_DEFAULT, ...).  NULL turns this off.  See linker_autoload().
+ */
+int dlautoload(const char *dir)
+{
+	int ret;
+
+	dl_init();
+	dl_write_lock();
+	ret = linker_autoload(dir);
+	dl_write_unlock();
+	return ret;
+}
+
+/* Load newpath as the new version of handle, opened with
+ * RTLD_REPLACEABLE, and send the calls of its functions there, see
+ * replace_library().  Returns the new handle, which takes over the
+ * references to the old one, or NULL with the old one left as it was.
+ * The old version goes after a grace period, see dlquiescent().
+ */
+void *dlreplace(void *handle, const char *newpath)
+{
+	soinfo *ret = NULL;
+
+	dl_init();
+	dl_write_lock();
+#ifdef DL_LAZY
+	if (find_plugin(handle) == NULL)
+		ret = replace_library((soinfo *)handle, newpath);
+#endif
+	if (unlikely(ret == NULL))
+		dl_last_err = DL_ERR_CANNOT_FIND_LIBRARY;
+	linker_unlock();
+	return ret;
+}
+
+/* See dlfcn.h.  The last thread a replaced module waits for unloads it. */
+void dlquiescent(void)
+{
+	dl_quiescent();
+	if (linker_retiring()) {
+		dl_write_lock();
+		linker_unlock();
+	}
+}
+
 const char *dlerror(void)
 {
     const char *err = dl_errors[dl_last_err];
@@ -73,11 +364,15 @@ const char *dlerror(void)
     return err;
 }
 
+/* Lookups do not take the loader lock, see dlrcu.h */
 void *dlsym(void *handle, const char *symbol)
 {
     unsigned long sym;
+#ifdef DL_LAZY
+    struct dl_plugin *plugin;
+#endif
 
-    cexpLock(dl_lock);
+    dl_read_lock();
     
     if(unlikely(handle == 0)) { 
         dl_last_err = DL_ERR_INVALID_LIBRARY_HANDLE;
@@ -90,27 +385,56 @@ void *dlsym(void *handle, const char *symbol)
     
     if(handle == RTLD_DEFAULT) {
         sym = lookup(symbol);
+        if(sym == 0 && linker_provides(symbol)) {
+            /* in an object not loaded yet */
+            dl_read_unlock();
+            dl_write_lock();
+            /* unless someone else loaded it meanwhile */
+            sym = lookup(symbol);
+            if(sym == 0)
+                sym = autoload_symbol(symbol);
+            linker_unlock();
+            dl_read_lock();
+        }
     } else if(handle == RTLD_NEXT) {
         sym = lookup(symbol);
+#ifdef DL_LAZY
+    } else if((plugin = find_plugin(handle)) != NULL) {
+        /* may load it */
+        dl_read_unlock();
+        dl_write_lock();
+        sym = lookup_in_plugin(plugin, symbol);
+        linker_unlock();
+        dl_read_lock();
+#endif
     } else {
         sym = lookup_in_library((soinfo*) handle, symbol);
     }
     
     if(likely(sym != 0)) {
-        cexpUnlock(dl_lock);
+        dl_read_unlock();
         return (void*)sym;
     }
     else dl_last_err = DL_ERR_SYMBOL_NOT_FOUND;
 
 err:
-    cexpUnlock(dl_lock);
+    dl_read_unlock();
     return 0;
 }
 
 int dlclose(void *handle)
 {
-	cexpLock(dl_lock);
+#ifdef DL_LAZY
+	struct dl_plugin *plugin;
+#endif
+
+	dl_write_lock();
+#ifdef DL_LAZY
+	if ((plugin = find_plugin(handle)) != NULL)
+		(void)close_plugin(plugin);
+	else
+#endif
 	(void)unload_library((soinfo*)handle);
-	cexpUnlock(dl_lock);
+	linker_unlock();
 	return 0;
 }
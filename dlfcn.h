@@ -5,10 +5,29 @@
 #ifndef __DLFCN_H__
 #define __DLFCN_H__
 
+#include <stddef.h>
+
 extern void *dlopen(const char*  filename, int flag);
 extern int dlclose(void*  handle);
 extern const char *dlerror(void);
 extern void *dlsym(void*  handle, const char*  symbol);
+/* not POSIX, see dlfcn.c */
+extern void *dlopen_mem(const char *name, const void *buf, size_t len, int flag);
+extern int dlopen_many(const char **filenames, int n, int flag, void **handles);
+extern int dlprelink(const char *dir);
+extern int dllayout(int flags);
+extern int dlprofile(const char *file);
+extern int dlautoload(const char *dir);
+extern void *dlreplace(void *handle, const char *newpath);
+/* A thread that may call functions of RTLD_REPLACEABLE modules calls
+ * dlquiescent() once before its first such call, and from then on
+ * whenever it is in none of them and keeps no address it got from one,
+ * e.g. between two requests and before blocking.  The version dlreplace()
+ * replaced is only unloaded once each of those threads has called it
+ * since; threads that never called it are not waited for.  Where threads
+ * are not tracked (RTEMS) replaced versions stay loaded.
+ */
+extern void dlquiescent(void);
 
 enum {
   RTLD_NOW  = 0,
@@ -16,9 +35,21 @@ enum {
 
   RTLD_LOCAL  = 0,
   RTLD_GLOBAL = 2,
+
+  RTLD_DEFER  = 4,	/* not POSIX, load on first call, see dlopen() */
+  RTLD_REPLACEABLE = 8,	/* not POSIX, see dlreplace() */
 };
 
 #define RTLD_NEXT       ((void *) -1)
 #define RTLD_DEFAULT    ((void *) -2)
 
+/* dllayout() flags */
+#define DL_LAYOUT_CACHELINE	1	/* writable sections on cache lines of their own */
+#define DL_LAYOUT_PAGE		2	/* data on pages of its own */
+#define DL_LAYOUT_GC		4	/* only sections reachable from the exports */
+#define DL_LAYOUT_POOL		8	/* text of all modules together, sealed read+execute */
+#define DL_LAYOUT_HUGEPAGE	16	/* back the pools with huge pages */
+#define DL_LAYOUT_MERGE	32	/* share mergeable strings and constants between modules */
+#define DL_LAYOUT_FOLD		64	/* load identical functions once */
+
 #endif /* __DLFCN_H */
@@ -0,0 +1,73 @@
+/* Index of folded functions, see dlfold.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "cexplock.h"
+#include "dlfold.h"
+#include "linker_debug.h"
+
+static CexpLock fold_lock;
+static struct dl_chain folds;
+
+int dl_fold_init(void)
+{
+	return cexpLockCreate(&fold_lock);
+}
+
+/* The address of the copy of the function with this key, or 0 */
+unsigned long dl_fold_find(const void *key, size_t size, uint32_t hash,
+			const void **owner)
+{
+	struct dl_chain_link *l;
+	struct dl_fold *f;
+	unsigned long addr = 0;
+
+	cexpLock(fold_lock);
+	for (l = dl_chain_first(&folds, hash); l; l = l->next) {
+		f = (struct dl_fold *)l;
+		if (l->hash == hash && f->size == size &&
+			!memcmp(f + 1, key, size)) {
+			addr = f->addr;
+			*owner = f->owner;
+			break;
+		}
+	}
+	cexpUnlock(fold_lock);
+	return addr;
+}
+
+struct dl_fold *dl_fold_add(const void *key, size_t size, uint32_t hash,
+			unsigned long addr, const void *owner)
+{
+	struct dl_fold *f;
+
+	f = malloc(sizeof(*f) + size);
+	if (f == NULL) {
+		ERROR("malloc failed!\n");
+		return NULL;
+	}
+	f->link.hash = hash;
+	f->size = size;
+	f->addr = addr;
+	f->owner = owner;
+	memcpy(f + 1, key, size);
+
+	cexpLock(fold_lock);
+	if (dl_chain_add(&folds, &f->link) < 0) {
+		cexpUnlock(fold_lock);
+		free(f);
+		ERROR("calloc failed!\n");
+		return NULL;
+	}
+	cexpUnlock(fold_lock);
+	return f;
+}
+
+void dl_fold_remove(struct dl_fold *f)
+{
+	cexpLock(fold_lock);
+	dl_chain_remove(&folds, &f->link);
+	cexpUnlock(fold_lock);
+	free(f);
+}
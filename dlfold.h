@@ -0,0 +1,35 @@
+/* Index of folded functions
+ *
+ * With DL_LAYOUT_FOLD every function section that refers to nothing in
+ * its own module is keyed by its contents and the targets of its
+ * relocations, see fold_key() in linker.c.  The first module to load a
+ * function records where its copy is; modules loaded later that have the
+ * same function use that copy instead of loading their own.  Entries are
+ * added and removed under the loader lock, and removed when the module
+ * holding the copy goes; dl_fold_find() may be called without it.
+ */
+#ifndef _LINKER_DLFOLD_H_
+#define _LINKER_DLFOLD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dlchain.h"
+
+struct dl_fold
+{
+	struct dl_chain_link link;
+	uint32_t size;		/* of the key */
+	unsigned long addr;	/* of the copy */
+	const void *owner;	/* the module holding it */
+	/* the key follows */
+};
+
+int dl_fold_init(void);
+unsigned long dl_fold_find(const void *key, size_t size, uint32_t hash,
+			const void **owner);
+struct dl_fold *dl_fold_add(const void *key, size_t size, uint32_t hash,
+			unsigned long addr, const void *owner);
+void dl_fold_remove(struct dl_fold *f);
+
+#endif
@@ -0,0 +1,208 @@
+/* Shared pools for module images, see dlmem.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dlmem.h"
+#include "linker_debug.h"
+
+#ifdef DL_POOLS
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB	0x40000
+#endif
+
+#define POOL_ROUND(x, a)	(((x) + (a) - 1) & ~(size_t)((a) - 1))
+
+struct dl_pool_extent
+{
+	struct dl_pool_extent *next;
+	char *base;
+	size_t size;
+};
+
+/* Put [base, base + size) on the free list, merging it with its
+ * neighbours.  Called with the pool locked.
+ */
+static int pool_release(struct dl_pool *p, char *base, size_t size)
+{
+	struct dl_pool_extent **link = &p->free, *e, *prev = NULL;
+
+	while (*link && (*link)->base < base) {
+		prev = *link;
+		link = &(*link)->next;
+	}
+	if (prev && prev->base + prev->size == base) {
+		prev->size += size;
+		e = prev->next;
+		if (e && prev->base + prev->size == e->base) {
+			prev->size += e->size;
+			prev->next = e->next;
+			free(e);
+		}
+		return 0;
+	}
+	e = *link;
+	if (e && base + size == e->base) {
+		e->base = base;
+		e->size += size;
+		return 0;
+	}
+	e = malloc(sizeof(*e));
+	if (e == NULL) {
+		ERROR("malloc failed!\n");
+		return -1;
+	}
+	e->base = base;
+	e->size = size;
+	e->next = *link;
+	*link = e;
+	return 0;
+}
+
+/* Map a new chunk of at least size bytes, aligned to DL_POOL_CHUNK */
+static int pool_grow(struct dl_pool *p, size_t size)
+{
+	size_t csize = POOL_ROUND(size, DL_POOL_CHUNK);
+	char *map, *chunk;
+
+	if (p->huge && !p->exec) {
+		map = mmap(NULL, csize, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (map != MAP_FAILED) {
+			TRACE("%s pool: %lu bytes of huge pages @ %p\n", p->name,
+				(unsigned long)csize, map);
+			chunk = map;
+			goto got;
+		}
+		TRACE("%s pool: no huge pages, trying transparent ones\n", p->name);
+	}
+
+	/* over-allocate and trim to get the alignment */
+	map = mmap(NULL, csize + DL_POOL_CHUNK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		ERROR("%s pool: mmap failed!\n", p->name);
+		return -1;
+	}
+	chunk = (char *)POOL_ROUND((unsigned long)map, DL_POOL_CHUNK);
+	if (chunk > map)
+		munmap(map, chunk - map);
+	munmap(chunk + csize, map + DL_POOL_CHUNK - chunk);
+#ifdef MADV_HUGEPAGE
+	if (p->huge)
+		madvise(chunk, csize, MADV_HUGEPAGE);
+#endif
+	TRACE("%s pool: %lu bytes @ %p\n", p->name, (unsigned long)csize, chunk);
+
+got:
+	if (pool_release(p, chunk, csize) < 0) {
+		munmap(chunk, csize);
+		return -1;
+	}
+	p->mapped += csize;
+	return 0;
+}
+
+/* First fit, the space before and after the block staying free */
+void *dl_pool_alloc(struct dl_pool *p, size_t size, size_t align)
+{
+	struct dl_pool_extent *e, *tail;
+	char *start, *end;
+
+	if (align < p->granule)
+		align = p->granule;
+	size = POOL_ROUND(size ? size : 1, p->granule);
+	if (align > DL_POOL_CHUNK) {
+		ERROR("%s pool: alignment %lu too large\n", p->name,
+			(unsigned long)align);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		for (e = p->free; e; e = e->next) {
+			start = (char *)POOL_ROUND((unsigned long)e->base, align);
+			if (start < e->base + e->size &&
+				size <= (size_t)(e->base + e->size - start))
+				break;
+		}
+		if (e)
+			break;
+		if (pool_grow(p, size) < 0) {
+			pthread_mutex_unlock(&p->lock);
+			return NULL;
+		}
+	}
+	end = start + size;
+	if (end < e->base + e->size) {
+		if (start == e->base) {
+			e->size -= size;
+			e->base = end;
+			goto done;
+		}
+		tail = malloc(sizeof(*tail));
+		if (tail == NULL) {
+			pthread_mutex_unlock(&p->lock);
+			ERROR("malloc failed!\n");
+			return NULL;
+		}
+		tail->base = end;
+		tail->size = e->base + e->size - end;
+		tail->next = e->next;
+		e->next = tail;
+	}
+	e->size = start - e->base;
+	if (e->size == 0) {
+		struct dl_pool_extent **link = &p->free;
+
+		/* all of it is used */
+		while (*link != e)
+			link = &(*link)->next;
+		*link = e->next;
+		free(e);
+	}
+done:
+	p->used += size;
+	pthread_mutex_unlock(&p->lock);
+	/* freed space is handed out again */
+	memset(start, 0, size);
+	return start;
+}
+
+/* ptr and size as allocated; nothing may be using the memory any more */
+void dl_pool_free(struct dl_pool *p, void *ptr, size_t size)
+{
+	size = POOL_ROUND(size ? size : 1, p->granule);
+	if (p->exec && mprotect(ptr, size, PROT_READ | PROT_WRITE) < 0)
+		ERROR("%s pool: mprotect failed!\n", p->name);
+	pthread_mutex_lock(&p->lock);
+	if (pool_release(p, ptr, size) == 0)
+		p->used -= size;
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Whether chunks mapped from now on are backed with huge pages */
+void dl_pool_set_huge(struct dl_pool *p, int huge)
+{
+	pthread_mutex_lock(&p->lock);
+	p->huge = huge;
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Make text read+execute once it is relocated; it is not written again */
+int dl_pool_seal(struct dl_pool *p, void *ptr, size_t size)
+{
+	if (!p->exec)
+		return 0;
+	size = POOL_ROUND(size ? size : 1, p->granule);
+	if (mprotect(ptr, size, PROT_READ | PROT_EXEC) < 0) {
+		ERROR("%s pool: mprotect failed!\n", p->name);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* DL_POOLS */
@@ -0,0 +1,60 @@
+/* Shared pools for module images
+ *
+ * With DL_LAYOUT_POOL the text of every module goes into one pool and
+ * its data and bss into another, rather than each module getting a heap
+ * block of its own.  Pools grow by chunks of at least DL_POOL_CHUNK
+ * bytes, aligned to that size, and never shrink; freed space is kept on
+ * an address ordered list and reused.  Text is handed out in whole pages,
+ * writable while the module is loaded, and sealed read+execute with
+ * dl_pool_seal() once it is relocated.
+ *
+ * With DL_LAYOUT_HUGEPAGE new chunks are advised for transparent huge
+ * pages.  The data pool tries explicit huge pages (MAP_HUGETLB) first;
+ * the text pool does not, as its pages change protection one module at
+ * a time, which hugetlbfs mappings cannot do.  Sealed text pages of
+ * neighbouring modules end up in one read+execute mapping again, which
+ * the kernel can back with huge pages.
+ */
+#ifndef _LINKER_DLMEM_H_
+#define _LINKER_DLMEM_H_
+
+#include <stddef.h>
+
+#include "linker.h"
+
+/* only where memory can be mapped and protected */
+#ifdef DL_USE_MMAP
+#define DL_POOLS
+#endif
+
+#ifdef DL_POOLS
+#include <pthread.h>
+
+#define DL_POOL_CHUNK	(2 * 1024 * 1024)
+
+struct dl_pool_extent;
+
+struct dl_pool
+{
+	const char *name;
+	size_t granule;		/* allocation unit, a power of 2 */
+	int exec;		/* a text pool, see dl_pool_seal() */
+	int huge;		/* back new chunks with huge pages */
+	pthread_mutex_t lock;
+	struct dl_pool_extent *free;
+	size_t mapped;		/* bytes of chunks */
+	size_t used;		/* bytes handed out */
+};
+
+#define DL_POOL_INIT(name, granule, exec) \
+	{ name, granule, exec, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 }
+
+/* Zeroed memory, or NULL */
+void *dl_pool_alloc(struct dl_pool *p, size_t size, size_t align);
+void dl_pool_free(struct dl_pool *p, void *ptr, size_t size);
+int dl_pool_seal(struct dl_pool *p, void *ptr, size_t size);
+void dl_pool_set_huge(struct dl_pool *p, int huge);
+
+#endif /* DL_POOLS */
+
+#endif
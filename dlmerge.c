@@ -0,0 +1,162 @@
+/* Pool of mergeable section contents, see dlmerge.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "cexplock.h"
+#include "dlmerge.h"
+#include "linker_debug.h"
+
+#define MERGE_CHUNK	16384	/* bytes of a chunk, or one entry */
+
+/* Contents are packed into chunks from the start up, each aligned as asked
+ * for, their entries from the end down.  The space of an entry is not used
+ * again until its chunk is freed with the last entry in it.
+ */
+struct dl_merge_chunk
+{
+	unsigned live;		/* entries in it */
+	char *lo, *hi;		/* the space left */
+	char *end;
+};
+
+static CexpLock merge_lock;
+static struct dl_chain pool;
+static struct dl_merge_chunk *current;	/* the one being filled */
+
+/* FNV-1a */
+uint32_t dl_merge_hash(const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	uint32_t h = 2166136261U;
+
+	while (size--) {
+		h ^= *p++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Drop the space of e, with the lock held */
+static void merge_free(struct dl_merge_entry *e)
+{
+	struct dl_merge_chunk *c = e->chunk;
+
+	if (--c->live)
+		return;
+	if (c == current) {
+		c->lo = (char *)(c + 1);
+		c->hi = c->end;
+	} else {
+		free(c);
+	}
+}
+
+int dl_merge_init(void)
+{
+	return cexpLockCreate(&merge_lock);
+}
+
+/* A new chunk big enough for size bytes aligned to align, and an entry;
+ * MERGE_CHUNK bytes unless that is not enough.
+ */
+static struct dl_merge_chunk *chunk_new(size_t size, size_t align)
+{
+	struct dl_merge_chunk *c;
+	size_t n = sizeof(*c) + size + align +
+		2 * sizeof(struct dl_merge_entry);
+
+	if (n < MERGE_CHUNK)
+		n = MERGE_CHUNK;
+	c = malloc(n);
+	if (c == NULL)
+		return NULL;
+	c->live = 0;
+	c->lo = (char *)(c + 1);
+	c->hi = c->end = (char *)c + n;
+	return c;
+}
+
+/* An entry for size bytes aligned to align in c, or NULL if they do not
+ * fit in what is left of it
+ */
+static struct dl_merge_entry *chunk_alloc(struct dl_merge_chunk *c,
+			size_t size, size_t align)
+{
+	unsigned long lo, hi;
+	struct dl_merge_entry *e;
+
+	lo = ((unsigned long)c->lo + align - 1) & ~(align - 1);
+	hi = ((unsigned long)c->hi - sizeof(*e)) &
+		~(unsigned long)(__alignof__(*e) - 1);
+	if (hi < (unsigned long)c->lo || lo > hi || hi - lo < size)
+		return NULL;
+	c->lo = (char *)lo + size;
+	c->hi = (char *)hi;
+	c->live++;
+	e = (struct dl_merge_entry *)hi;
+	e->chunk = c;
+	e->data = (char *)lo;
+	return e;
+}
+
+struct dl_merge_entry *dl_merge_get(const void *data, size_t size, size_t align)
+{
+	struct dl_chain_link *l;
+	struct dl_merge_entry *e;
+	struct dl_merge_chunk *c;
+	uint32_t hash = dl_merge_hash(data, size);
+
+	cexpLock(merge_lock);
+	for (l = dl_chain_first(&pool, hash); l; l = l->next) {
+		e = (struct dl_merge_entry *)l;
+		/* only reuse a copy that is aligned well enough */
+		if (l->hash == hash && e->size == size &&
+			((unsigned long)e->data & (align - 1)) == 0 &&
+			!memcmp(e->data, data, size)) {
+			e->refs++;
+			cexpUnlock(merge_lock);
+			return e;
+		}
+	}
+
+	e = current ? chunk_alloc(current, size, align) : NULL;
+	if (e == NULL) {
+		c = chunk_new(size, align);
+		if (c == NULL)
+			goto fail;
+		e = chunk_alloc(c, size, align);
+		/* a large entry gets a chunk of its own, the rest goes on */
+		if (c->lo < c->hi &&
+			(size_t)(c->hi - c->lo) >= MERGE_CHUNK / 4) {
+			if (current && current->live == 0)
+				free(current);
+			current = c;
+		}
+	}
+	e->link.hash = hash;
+	e->size = size;
+	e->refs = 1;
+	memcpy(e->data, data, size);
+	if (dl_chain_add(&pool, &e->link) < 0) {
+		merge_free(e);
+		goto fail;
+	}
+	cexpUnlock(merge_lock);
+	return e;
+
+fail:
+	cexpUnlock(merge_lock);
+	ERROR("malloc failed!\n");
+	return NULL;
+}
+
+void dl_merge_put(struct dl_merge_entry *e)
+{
+	cexpLock(merge_lock);
+	if (--e->refs == 0) {
+		dl_chain_remove(&pool, &e->link);
+		merge_free(e);
+	}
+	cexpUnlock(merge_lock);
+}
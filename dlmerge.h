@@ -0,0 +1,35 @@
+/* Pool of mergeable section contents
+ *
+ * With DL_LAYOUT_MERGE the strings of SHF_MERGE|SHF_STRINGS sections and
+ * the entries of other SHF_MERGE sections (.rodata.cst16 and the like)
+ * are kept once for all modules.  dl_merge_get() returns the pooled copy
+ * of some contents, adding a reference; dl_merge_put() drops one and
+ * frees the copy with the last.  Entries are found by content in a
+ * chained hash table, see dlchain.h, and never move.  They are packed
+ * into chunks of the pool, the contents of a module loaded on its own
+ * lying next to each other.
+ */
+#ifndef _LINKER_DLMERGE_H_
+#define _LINKER_DLMERGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dlchain.h"
+
+struct dl_merge_entry
+{
+	struct dl_chain_link link;
+	uint32_t size;
+	unsigned refs;
+	char *data;		/* aligned as asked for */
+	struct dl_merge_chunk *chunk;	/* holding both */
+};
+
+int dl_merge_init(void);
+uint32_t dl_merge_hash(const void *data, size_t size);
+struct dl_merge_entry *dl_merge_get(const void *data, size_t size,
+			size_t align);
+void dl_merge_put(struct dl_merge_entry *e);
+
+#endif
@@ -0,0 +1,211 @@
+/* Loader locking, see dlrcu.h
+ */
+#include <stdlib.h>
+#include <sched.h>
+
+#include "cexplock.h"
+#include "dlrcu.h"
+#include "linker_debug.h"
+
+static CexpLock dl_lock;
+
+int dl_rcu_init(void)
+{
+	return cexpLockCreate(&dl_lock);
+}
+
+void dl_write_lock(void)
+{
+	cexpLock(dl_lock);
+}
+
+#ifdef DL_RCU
+
+struct dl_deferred
+{
+	void (*fn)(void *);
+	void *arg;
+	unsigned long epoch;
+	struct dl_deferred *next;
+};
+
+volatile unsigned long dl_epoch = 1;
+__thread struct dl_reader *dl_self;
+static struct dl_reader * volatile dl_readers;
+static pthread_key_t dl_reader_key;
+static pthread_once_t dl_reader_once = PTHREAD_ONCE_INIT;
+static struct dl_deferred *dl_deferred;
+
+static void dl_reader_exit(void *arg)
+{
+	struct dl_reader *r = arg;
+
+	r->epoch = 0;
+	r->quiescent = 0;
+	__sync_synchronize();
+	r->inuse = 0;
+}
+
+static void dl_reader_key_create(void)
+{
+	pthread_key_create(&dl_reader_key, dl_reader_exit);
+}
+
+/* First lookup of a thread: take over the record of a thread that has
+ * exited, or add a new one.  Records are never freed, so the writer can
+ * walk the list without a lock.
+ */
+struct dl_reader *dl_reader_register(void)
+{
+	struct dl_reader *r;
+
+	pthread_once(&dl_reader_once, dl_reader_key_create);
+	for (r = dl_readers; r; r = r->next) {
+		if (!r->inuse && __sync_bool_compare_and_swap(&r->inuse, 0, 1))
+			break;
+	}
+	if (r == NULL) {
+		r = calloc(1, sizeof(*r));
+		if (r == NULL) {
+			ERROR("calloc failed!\n");
+			abort();
+		}
+		r->inuse = 1;
+		do {
+			r->next = dl_readers;
+		} while (!__sync_bool_compare_and_swap(&dl_readers, r->next, r));
+	}
+	pthread_setspecific(dl_reader_key, r);
+	dl_self = r;
+	return r;
+}
+
+/* Oldest epoch a reader is active in, or 0 if nobody is reading */
+static unsigned long dl_oldest_reader(void)
+{
+	struct dl_reader *r;
+	unsigned long e, oldest = 0;
+
+	__sync_synchronize();
+	for (r = dl_readers; r; r = r->next) {
+		e = r->epoch;
+		if (e && (!oldest || e < oldest))
+			oldest = e;
+	}
+	return oldest;
+}
+
+/* A deferred object retired at epoch E can be reclaimed once every
+ * active reader entered in epoch E or later: those readers started
+ * after it was unpublished.
+ */
+static void dl_reclaim(void)
+{
+	struct dl_deferred **pp = &dl_deferred, *d;
+	unsigned long oldest = dl_oldest_reader();
+
+	while ((d = *pp)) {
+		if (!oldest || d->epoch <= oldest) {
+			*pp = d->next;
+			d->fn(d->arg);
+			free(d);
+		} else {
+			pp = &d->next;
+		}
+	}
+}
+
+void dl_defer(void (*fn)(void *), void *arg)
+{
+	struct dl_deferred *d;
+
+	if (arg == NULL)
+		return;
+	d = malloc(sizeof(*d));
+	if (d == NULL) {
+		dl_synchronize();
+		fn(arg);
+		return;
+	}
+	d->fn = fn;
+	d->arg = arg;
+	d->epoch = __sync_add_and_fetch(&dl_epoch, 1);
+	d->next = dl_deferred;
+	dl_deferred = d;
+}
+
+void dl_synchronize(void)
+{
+	unsigned long epoch = __sync_add_and_fetch(&dl_epoch, 1), oldest;
+
+	while ((oldest = dl_oldest_reader()) && oldest < epoch)
+		sched_yield();
+}
+
+void dl_write_unlock(void)
+{
+	if (dl_deferred)
+		dl_reclaim();
+	cexpUnlock(dl_lock);
+}
+
+/* The calling thread runs no replaced code and holds no address into it */
+void dl_quiescent(void)
+{
+	struct dl_reader *r = dl_self ? dl_self : dl_reader_register();
+
+	__sync_synchronize();
+	r->quiescent = dl_epoch;
+}
+
+unsigned long dl_grace_begin(void)
+{
+	return __sync_add_and_fetch(&dl_epoch, 1);
+}
+
+/* Threads that never reported are not waited for, nor exited ones */
+int dl_grace_over(unsigned long epoch)
+{
+	struct dl_reader *r;
+
+	__sync_synchronize();
+	for (r = dl_readers; r; r = r->next) {
+		if (r->inuse && r->quiescent && r->quiescent < epoch)
+			return 0;
+	}
+	return 1;
+}
+
+#else /* !DL_RCU */
+
+/* readers hold the writer lock, nothing can be referencing arg */
+void dl_defer(void (*fn)(void *), void *arg)
+{
+	if (arg)
+		fn(arg);
+}
+
+void dl_synchronize(void)
+{
+}
+
+void dl_write_unlock(void)
+{
+	cexpUnlock(dl_lock);
+}
+
+void dl_quiescent(void)
+{
+}
+
+unsigned long dl_grace_begin(void)
+{
+	return 0;
+}
+
+int dl_grace_over(unsigned long epoch)
+{
+	return 0;
+}
+
+#endif /* DL_RCU */
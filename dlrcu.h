@@ -0,0 +1,85 @@
+/* Loader locking: lock-free readers, serialized writers
+ *
+ * dlopen()/dlclose() serialize on the writer lock, though dlopen() only
+ * takes it to commit a module it has read and relocated.  On Linux, lookups
+ * only mark themselves active in the current epoch; data they might be
+ * looking at is published with dl_rcu_assign() and, once unpublished,
+ * handed to dl_defer() rather than freed, so it is only reclaimed after
+ * every reader that could have seen it has left.  Targets without
+ * thread local storage (RTEMS) simply take the writer lock for reading.
+ */
+#ifndef _LINKER_DLRCU_H_
+#define _LINKER_DLRCU_H_
+
+#ifdef __linux__
+#define DL_RCU
+#endif
+
+int dl_rcu_init(void);
+void dl_write_lock(void);
+void dl_write_unlock(void);
+
+/* Run fn(arg) once no reader can still reference arg.  Writers only. */
+void dl_defer(void (*fn)(void *), void *arg);
+#define dl_defer_free(p)	dl_defer(free, (p))
+/* Wait until every reader active now has left.  Writers only. */
+void dl_synchronize(void);
+
+/* Grace periods for code threads may be running, see dlquiescent():
+ * dl_grace_begin() starts one, dl_grace_over() tells whether every thread
+ * reporting quiescent states has reported one since.  Without DL_RCU
+ * threads are not tracked and grace periods do not end.
+ */
+void dl_quiescent(void);
+unsigned long dl_grace_begin(void);
+int dl_grace_over(unsigned long epoch);
+
+#ifdef DL_RCU
+
+struct dl_reader
+{
+	volatile unsigned long epoch;	/* 0 when not reading */
+	volatile unsigned long quiescent;	/* last reported, or 0 */
+	volatile int inuse;
+	struct dl_reader *next;
+};
+
+extern volatile unsigned long dl_epoch;
+extern __thread struct dl_reader *dl_self;
+struct dl_reader *dl_reader_register(void);
+
+static inline void dl_read_lock(void)
+{
+	struct dl_reader *r = dl_self ? dl_self : dl_reader_register();
+
+	r->epoch = dl_epoch;
+	__sync_synchronize();
+}
+
+static inline void dl_read_unlock(void)
+{
+	__sync_synchronize();
+	dl_self->epoch = 0;
+}
+
+/* Loads on x86 and SPARC (TSO) are not reordered with each other */
+#if defined(__i386__) || defined(__x86_64__) || defined(__sparc__)
+#define dl_read_barrier()	__asm__ __volatile__("" ::: "memory")
+#else
+#define dl_read_barrier()	__sync_synchronize()
+#endif
+
+#else /* !DL_RCU */
+
+#define dl_read_lock()		dl_write_lock()
+#define dl_read_unlock()	dl_write_unlock()
+#define dl_read_barrier()	do {} while (0)
+
+#endif /* DL_RCU */
+
+/* Publish a fully initialized object to readers, and read it back */
+#define dl_rcu_assign(p, v)	do { __sync_synchronize(); (p) = (v); } while (0)
+#define dl_rcu_dereference(p)	({ __typeof__(p) _p = *(__typeof__(p) volatile *)&(p); \
+					dl_read_barrier(); _p; })
+
+#endif
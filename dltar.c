@@ -0,0 +1,159 @@
+/* Objects in an in-memory tar archive, see dltar.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dlfcn.h"
+#include "dltar.h"
+#include "linker_debug.h"
+
+#define TAR_BLOCK	512
+
+struct tar_header
+{
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+};
+
+static size_t tar_octal(const char *p, size_t len)
+{
+	size_t v = 0;
+
+	while (len && *p == ' ') {
+		p++;
+		len--;
+	}
+	for (; len && *p >= '0' && *p <= '7'; p++, len--)
+		v = (v << 3) + (*p - '0');
+	return v;
+}
+
+/* "prefix/name" of a member, without any leading "./" */
+static size_t tar_name(const struct tar_header *h, char *buf)
+{
+	size_t n = 0, len;
+	const char *name = h->name;
+
+	if (!memcmp(h->magic, "ustar", 5) && h->prefix[0]) {
+		len = strnlen(h->prefix, sizeof(h->prefix));
+		if (buf) {
+			memcpy(buf, h->prefix, len);
+			buf[len] = '/';
+		}
+		n = len + 1;
+	}
+	len = strnlen(h->name, sizeof(h->name));
+	if (n == 0 && len > 2 && name[0] == '.' && name[1] == '/') {
+		name += 2;
+		len -= 2;
+	}
+	if (buf) {
+		memcpy(buf + n, name, len);
+		buf[n + len] = '\0';
+	}
+	return n + len + 1;
+}
+
+/* Two passes over the headers: count the files and the length of their
+ * names, then fill in the index.
+ */
+int dl_tar_index(struct dl_tar *tar, const void *buf, size_t len)
+{
+	const char *p, *end = (const char *)buf + len;
+	const struct tar_header *h;
+	struct dl_tar_member *m = NULL;
+	size_t size, namelen = 0;
+	char *q = NULL;
+	unsigned n = 0;
+	int pass;
+
+	memset(tar, 0, sizeof(*tar));
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			tar->members = malloc((n ? n : 1) * sizeof(*tar->members));
+			tar->names = q = malloc(namelen ? namelen : 1);
+			if (tar->members == NULL || tar->names == NULL) {
+				ERROR("malloc failed!\n");
+				dl_tar_free(tar);
+				return -1;
+			}
+			m = tar->members;
+		}
+		for (p = buf; end - p >= TAR_BLOCK; ) {
+			h = (const struct tar_header *)p;
+			if (h->name[0] == '\0')
+				break;		/* end of archive */
+			size = tar_octal(h->size, sizeof(h->size));
+			p += TAR_BLOCK;
+			if (size > (size_t)(end - p)) {
+				ERROR("truncated tar member\n");
+				dl_tar_free(tar);
+				return -1;
+			}
+			if (h->typeflag == '0' || h->typeflag == '\0') {
+				if (pass == 0) {
+					n++;
+					namelen += tar_name(h, NULL);
+				} else {
+					m->name = q;
+					q += tar_name(h, q);
+					m->data = p;
+					m->size = size;
+					TRACE("tar member %s: %lu bytes\n", m->name,
+						(unsigned long)size);
+					m++;
+				}
+			}
+			p += (size + TAR_BLOCK - 1) & ~(size_t)(TAR_BLOCK - 1);
+		}
+	}
+	tar->n = n;
+	return 0;
+}
+
+void dl_tar_free(struct dl_tar *tar)
+{
+	free(tar->members);
+	free(tar->names);
+	memset(tar, 0, sizeof(*tar));
+}
+
+const struct dl_tar_member *dl_tar_find(const struct dl_tar *tar,
+		const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < tar->n; i++) {
+		if (!strcmp(tar->members[i].name, name))
+			return tar->members + i;
+	}
+	return NULL;
+}
+
+/* Load a member in place; it is known to the loader by its name in the
+ * archive.
+ */
+void *dlopen_tar(const struct dl_tar *tar, const char *name, int flag)
+{
+	const struct dl_tar_member *m = dl_tar_find(tar, name);
+
+	if (m == NULL) {
+		ERROR("%s is not in the archive\n", name);
+		return NULL;
+	}
+	return dlopen_mem(m->name, m->data, m->size, flag);
+}
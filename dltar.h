@@ -0,0 +1,32 @@
+/* Objects in an in-memory tar archive
+ *
+ * dl_tar_index() lists the regular files of a ustar archive, such as one
+ * linked into the executable, without copying them; dlopen_tar() then
+ * loads a member straight from the archive.
+ */
+#ifndef _LINKER_DLTAR_H_
+#define _LINKER_DLTAR_H_
+
+#include <stddef.h>
+
+struct dl_tar_member
+{
+	const char *name;
+	const void *data;
+	size_t size;
+};
+
+struct dl_tar
+{
+	struct dl_tar_member *members;
+	unsigned n;
+	char *names;
+};
+
+int dl_tar_index(struct dl_tar *tar, const void *buf, size_t len);
+void dl_tar_free(struct dl_tar *tar);
+const struct dl_tar_member *dl_tar_find(const struct dl_tar *tar,
+		const char *name);
+void *dlopen_tar(const struct dl_tar *tar, const char *name, int flag);
+
+#endif
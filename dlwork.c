@@ -0,0 +1,65 @@
+/* Worker pool, see dlwork.h
+ */
+#include <unistd.h>
+
+#include "dlwork.h"
+#include "linker_debug.h"
+
+#ifdef DL_THREADS
+#include <pthread.h>
+
+struct dl_work
+{
+	void (*fn)(void *, unsigned);
+	void *arg;
+	unsigned n;
+	volatile unsigned next;
+};
+
+/* Workers take the next item until there are none left */
+static void *dl_worker(void *p)
+{
+	struct dl_work *w = p;
+	unsigned i;
+
+	while ((i = __sync_fetch_and_add(&w->next, 1)) < w->n)
+		w->fn(w->arg, i);
+	return NULL;
+}
+
+void dl_parallel(unsigned n, void (*fn)(void *, unsigned), void *arg)
+{
+	struct dl_work w = { fn, arg, n, 0 };
+	pthread_t tid[DL_MAX_WORKERS - 1];
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned i, nthreads;
+
+	nthreads = ncpu > 1 ? ncpu - 1 : 0;
+	if (nthreads > DL_MAX_WORKERS - 1)
+		nthreads = DL_MAX_WORKERS - 1;
+	if (nthreads > n - 1)
+		nthreads = n ? n - 1 : 0;
+
+	for (i = 0; i < nthreads; i++) {
+		/* short of threads the remaining ones do more of the work */
+		if (pthread_create(&tid[i], NULL, dl_worker, &w) != 0)
+			break;
+	}
+	nthreads = i;
+	TRACE("%u items on %u threads\n", n, nthreads + 1);
+	dl_worker(&w);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+}
+
+#else /* !DL_THREADS */
+
+void dl_parallel(unsigned n, void (*fn)(void *, unsigned), void *arg)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		fn(arg, i);
+}
+
+#endif /* DL_THREADS */
@@ -0,0 +1,19 @@
+/* Worker pool for loading several objects at once
+ *
+ * dl_parallel() calls fn(arg, i) for every i < n and returns when all
+ * calls are done.  On Linux the calls are spread over up to
+ * DL_MAX_WORKERS threads, the caller being one of them; elsewhere they
+ * simply run one after the other.
+ */
+#ifndef _LINKER_DLWORK_H_
+#define _LINKER_DLWORK_H_
+
+#ifdef __linux__
+#define DL_THREADS
+#endif
+
+#define DL_MAX_WORKERS	8
+
+void dl_parallel(unsigned n, void (*fn)(void *, unsigned), void *arg);
+
+#endif
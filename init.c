@@ -28,7 +28,8 @@
 #include <fcntl.h>
 #include <rtems/error.h>
 #include <rtems/shell.h>
-#include <rtems/untar.h>
+#include "dlfcn.h"
+#include "dltar.h"
 
 void writeFile(
   const char *name,
@@ -50,12 +51,19 @@ void writeFile(
   }
 }
 
+/*
+** objects linked in with the TARFILE, loaded in place
+*/
+static struct dl_tar boot_tar;
+
 /*
 ** dynamic load demo command
 */
 extern void demo(char *libname, char *symname);
 int demo_command(int argc, char *argv[])
 {
+   void *handle;
+
    /*
    ** Loading elf file
    */
@@ -66,7 +74,11 @@ int demo_command(int argc, char *argv[])
    }
    else
    {
+     /* straight from the archive, demo()'s dlopen() then finds it loaded */
+     handle = dlopen_tar(&boot_tar, argv[1], RTLD_NOW);
      demo(argv[1], argv[2]); 
+     if (handle)
+       dlclose(handle);
    }	
 
    return(0);
@@ -151,9 +163,10 @@ void fileio_start_shell(void)
     "echo j2   DOES NOT have the magic first line\n"
   );
 
-  printf("Populating Root file system from TAR file.\n");
-  Untar_FromMemory(
-        (unsigned char *)(&TARFILE_START), 
+  printf("Indexing objects in TAR file.\n");
+  dl_tar_index(
+        &boot_tar,
+        (const void *)(&TARFILE_START), 
         (unsigned long)&TARFILE_SIZE);
   printf("Adding Local Commands.\n");   
   rtems_add_local_cmds();
@@ -37,13 +37,27 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <zlib.h>
 
 #include "dlfcn.h"
+#include "dlrcu.h"
+#include "dlwork.h"
+#include "arena.h"
+#include "dlmem.h"
+#include "dlfold.h"
+#include "dlmerge.h"
 #include "linker.h"
+#include "prelink.h"
 #include "sym.h"
+#include "symhash.h"
+#include "sysmap.h"
 #include "linker_debug.h"
 
+#ifdef DL_USE_MMAP
+#include <sys/mman.h>
+#endif
+
 #define SO_MAX 64
 
 static int socount = 0;
@@ -53,9 +67,22 @@ static soinfo *solist = NULL;
 static soinfo *sonext = NULL;
 static struct dl_symbol *nocexp = NULL;
 static struct dl_symbol *syssyms = NULL;
+static struct symhash globalsyms;
+static struct symhash comdats;	/* COMDAT signatures, see comdat_groups() */
+static struct symhash modules;	/* loaded modules by name, see find_loaded_library() */
+static struct sysmap sysmap;
+static const struct dl_mph_table *sysmph = NULL;
 extern struct dl_symbol *cexpSystemSymbols __attribute__((weak, alias("nocexp")));
+extern const struct dl_mph_table cexpSystemSymtab __attribute__((weak));
 
 int debug_verbosity;
+/* bumped whenever a module goes away, see relocate_library() */
+static volatile unsigned long dl_unloads;
+/* replaced modules waiting for a grace period, see reclaim_retired() */
+static soinfo *retired;
+
+static void unpublish_exports(soinfo *si, unsigned n);
+static void run_pending(void);
 
 static soinfo *alloc_info(const char *name)
 {
@@ -84,6 +111,12 @@ static soinfo *alloc_info(const char *name)
     /* Make sure we get a clean block of soinfo */
     memset(si, 0, sizeof(soinfo));
     strcpy((char*) si->name, name);
+    if (symhash_insert(&modules, si->name, dl_gnu_hash(si->name),
+            (unsigned long)si, si) < 0) {
+        si->next = freelist;
+        freelist = si;
+        return NULL;
+    }
     if(solist == NULL)
         sonext = solist = si;
     else {
@@ -97,10 +130,39 @@ static soinfo *alloc_info(const char *name)
     return si;
 }
 
+/* Take a module out of every index, so that nothing new finds or binds
+ * to it; what is bound to it already may still use it.
+ */
+static void withdraw_library(soinfo *si)
+{
+    const char *sig;
+    unsigned i;
+
+    if (si->exports && (si->flags & FLAG_PUBLISHED)) {
+        unpublish_exports(si, si->exports->nsyms);
+        si->flags &= ~FLAG_PUBLISHED;
+    }
+    if (si->groups) {
+        for (i = 0, sig = si->groups; i < si->ngroups; i++) {
+            symhash_remove(&comdats, sig, dl_gnu_hash(sig), si);
+            sig += strlen(sig) + 1;
+        }
+        dl_defer_free(si->groups);
+        si->groups = NULL;
+    }
+    symhash_remove(&modules, si->name, dl_gnu_hash(si->name), si);
+    for (i = 0; i < si->nfolds; i++)
+        dl_fold_remove(si->folds[i]);
+    free(si->folds);
+    si->folds = NULL;
+    si->nfolds = 0;
+    __sync_synchronize();
+    dl_unloads++;
+}
+
 static void free_info(soinfo *si)
 {
     soinfo *prev = NULL, *trav;
-    struct dl_symbol_list *p;
 
     TRACE("name %s: freeing soinfo @ %p\n", si->name, si);
 
@@ -115,13 +177,16 @@ static void free_info(soinfo *si)
         return;
     }
 
-    for (p = si->dlsyms; p; p = p->next) {
-        free(p->sym.name);
-        p = p->next;
-        free(p);
-    }
+    withdraw_library(si);
+    /* lookups may still be reading the names */
+    dl_defer_free(si->exports);
+    si->exports = NULL;
+    free(si->owners);
+    si->owners = NULL;
     if (prev != NULL)
        prev->next = si->next;
+    else
+       solist = si->next;
     if (si == sonext) sonext = prev;
     si->next = freelist;
     freelist = si;
@@ -170,6 +235,41 @@ static int open_library(const char *name)
     return -1;
 }
 
+/* Module names are paths, "t.o", "./t.o" and ".//t.o" name the same
+ * module: "." components and repeated slashes are dropped, ".." is left
+ * alone.  buf holds SOINFO_NAME_LEN bytes; -1 if the name does not fit.
+ */
+static int canon_name(const char *name, char *buf)
+{
+    const char *p = name;
+    char *q = buf, *end = buf + SOINFO_NAME_LEN - 1;
+
+    if (*p == '/')
+        *q++ = *p++;
+    for (;;) {
+        while (*p == '/')
+            p++;
+        if (*p == '\0')
+            break;
+        if (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) {
+            p++;
+            continue;
+        }
+        if (q > buf && q[-1] != '/') {
+            if (q == end)
+                return -1;
+            *q++ = '/';
+        }
+        while (*p && *p != '/') {
+            if (q == end)
+                return -1;
+            *q++ = *p++;
+        }
+    }
+    *q = '\0';
+    return 0;
+}
+
 /* verify_elf_object
  *      Verifies if the object @ base is a valid ELF object
  *
@@ -199,57 +299,182 @@ verify_elf_object(void *base, const char *name)
     return 0;
 }
 
-static void elf_loadsection(int fd, Elf32_Shdr *s, char *q)
+/* The object file being loaded.  It is mapped (or, where mmap() is not
+ * available, read into the load's arena) in one piece, or it is in memory
+ * already, and the ELF header, section headers, symbol table, string
+ * tables and relocation sections are all used in place.  Only the
+ * sections that make up the module image are copied.
+ */
+struct elf_object
+{
+	const char *base;
+	size_t size;
+	int mapped;
+};
+
+static int elf_map(int fd, struct elf_object *obj, struct dl_arena *arena)
 {
-	lseek(fd, s->sh_offset, SEEK_SET);
-	read(fd, q, s->sh_size);
+	struct stat filestat;
+	char *buf;
+	size_t done;
+	ssize_t cnt;
+
+	if (fstat(fd, &filestat) < 0) {
+		ERROR("fstat() failed!\n");
+		return -1;
+	}
+	obj->size = filestat.st_size;
+	if (obj->size < sizeof(Elf32_Ehdr)) {
+		ERROR("file too small for an ELF object\n");
+		return -1;
+	}
+
+#ifdef DL_USE_MMAP
+	buf = mmap(NULL, obj->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf != MAP_FAILED) {
+		obj->base = buf;
+		obj->mapped = 1;
+		return 0;
+	}
+	TRACE("mmap() failed, falling back to read()\n");
+#endif
+
+	buf = dl_arena_alloc(arena, obj->size);
+	if (buf == NULL)
+		return -1;
+	for (done = 0; done < obj->size; done += cnt) {
+		cnt = read(fd, buf + done, obj->size - done);
+		if (cnt <= 0) {
+			ERROR("read failed!\n");
+			return -1;
+		}
+	}
+	obj->base = buf;
+	obj->mapped = 0;
+	return 0;
 }
 
-static void add_global_symbol(soinfo *si, char *name, unsigned long value)
+/* Use an object the caller has in memory.  It is parsed in place too,
+ * which needs the symbols and relocations aligned; a misaligned buffer is
+ * copied.
+ */
+static int elf_borrow(const void *buf, size_t len, struct elf_object *obj,
+		struct dl_arena *arena)
 {
-	struct dl_symbol_list *dlsym;
-	TRACE("%p add global symbol:%s@0x%lx\n", si, name, value);
-	dlsym = malloc(sizeof(*dlsym));
-	if (!dlsym) {
-		ERROR("malloc failed!\n");
+	char *copy;
+
+	if (len < sizeof(Elf32_Ehdr)) {
+		ERROR("buffer too small for an ELF object\n");
+		return -1;
+	}
+	obj->size = len;
+	obj->mapped = 0;
+	if ((unsigned long)buf & (sizeof(Elf32_Word) - 1)) {
+		TRACE("misaligned object buffer, copying\n");
+		copy = dl_arena_alloc(arena, len);
+		if (copy == NULL)
+			return -1;
+		memcpy(copy, buf, len);
+		buf = copy;
 	}
-	dlsym->sym.name = strdup(name);
-	dlsym->sym.value = value;
-	dlsym->next = si->dlsyms;
-	si->dlsyms = dlsym;
+	obj->base = buf;
+	return 0;
 }
 
-static unsigned long lookup_global_symbol(const char *name)
+/* Anything not mapped belongs to someone else or to the arena */
+static void elf_unmap(struct elf_object *obj)
 {
-	soinfo *si;
-	struct dl_symbol *entry;
-	struct dl_symbol_list *dlsym;
+#ifdef DL_USE_MMAP
+	if (obj->base && obj->mapped)
+		munmap((void *)obj->base, obj->size);
+#endif
+	obj->base = NULL;
+}
 
-	for (entry = syssyms; entry->name; ++entry) {
-		if (!strcmp(name, entry->name))
-			return entry->value;
+/* Check that a section's file contents lie within the object */
+static int elf_section_ok(struct elf_object *obj, Elf32_Shdr *s)
+{
+	if (s->sh_type == SHT_NOBITS)
+		return 1;
+	return s->sh_offset <= obj->size &&
+		s->sh_size <= obj->size - s->sh_offset;
+}
+
+/* Build the module's export table from the global definitions collected
+ * by define_symbols(); exports[] holds their symbol table indices.
+ */
+static struct dl_exports *build_exports(const Elf32_Sym *sym, const char *strtab,
+			Elf32_Addr *symvals, unsigned *exports, unsigned n,
+			struct dl_arena *arena)
+{
+	struct dl_export_def *defs;
+	unsigned i;
+
+	defs = dl_arena_alloc(arena, n * sizeof(*defs));
+	if (defs == NULL)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		defs[i].name = strtab + sym[exports[i]].st_name;
+		defs[i].hash = dl_gnu_hash(defs[i].name);
+		defs[i].value = symvals[exports[i]];
 	}
+	return exports_build(defs, n);
+}
+
+static void unpublish_exports(soinfo *si, unsigned n)
+{
+	struct dl_exports *ex = si->exports;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		symhash_remove(&globalsyms, dl_export_name(ex, i),
+				ex->hashes[i], si);
+}
+
+/* Add the module's exports to the global namespace */
+static int publish_exports(soinfo *si)
+{
+	struct dl_exports *ex = si->exports;
+	unsigned i;
 
-	for (si = solist; !si; si=si->next) {
-		for (dlsym = si->dlsyms; dlsym; dlsym=dlsym->next) {
-			if (!strcmp(name, dlsym->sym.name))
-				return dlsym->sym.value;
+	for (i = 0; i < ex->nsyms; i++) {
+		TRACE("%p add global symbol:%s@0x%lx\n", si,
+			dl_export_name(ex, i), ex->values[i]);
+		if (symhash_insert(&globalsyms, dl_export_name(ex, i),
+				ex->hashes[i], ex->values[i], si) < 0) {
+			unpublish_exports(si, i);
+			return -1;
 		}
 	}
+	si->flags |= FLAG_PUBLISHED;
 	return 0;
 }
 
+static unsigned long lookup_global_symbol(const char *name)
+{
+	const struct symhash_entry *e;
+	uint32_t hash = dl_gnu_hash(name);
+	unsigned long value;
+
+	if (sysmph && (value = sysmph_lookup(sysmph, name, hash)))
+		return value;
+	if (sysmap.hdr && (value = sysmap_lookup(&sysmap, name, hash)))
+		return value;
+	e = symhash_lookup(&globalsyms, name, hash);
+	return e ? e->value : 0;
+}
+
 unsigned long lookup_in_library(soinfo *si, const char *name)
 {
-	struct dl_symbol_list *dlsym;
+	unsigned long value;
+
 	TRACE("lookup symbol [%s] at %p\n", name, si);
-	for (dlsym = si->dlsyms; dlsym; dlsym=dlsym->next) {
-		if (!strcmp(name, dlsym->sym.name)){
-			TRACE("[%s] found at %lx\n", name, dlsym->sym.value);
-			return dlsym->sym.value;
-		}
-	}
-	return 0;
+	if (si->exports == NULL)
+		return 0;
+	value = exports_lookup(si->exports, name, dl_gnu_hash(name));
+	if (value)
+		TRACE("[%s] found at %lx\n", name, value);
+	return value;
 }
 
 unsigned long lookup(const char *name)
@@ -257,65 +482,143 @@ unsigned long lookup(const char *name)
     return lookup_global_symbol(name);
 }
 
-//resolve all symbols
-static void resolve_symbols(Elf32_Shdr *sechdrs, 
-			unsigned int symindex, 
-			char *strtab, soinfo *si)
+/* The section of symbol i, which is in the SHT_SYMTAB_SHNDX section
+ * xindex when the object has too many sections for st_shndx.
+ */
+static unsigned sym_shndx(const Elf32_Sym *sym, unsigned i,
+			const Elf32_Word *xindex)
+{
+	if (sym[i].st_shndx == SHN_XINDEX && xindex)
+		return xindex[i];
+	return sym[i].st_shndx;
+}
+
+//define the symbols of the object itself
+//the symbol table is left untouched, their values go into symvals[]
+//global definitions are recorded in exports[] for build_exports(),
+//undefined symbols in imports[] for resolve_imports()
+//symbols in sections that are not loaded keep the value 0
+static int define_symbols(Elf32_Shdr *sechdrs, unsigned shnum,
+			unsigned int symindex, const Elf32_Word *xindex,
+			const char *strtab, Elf32_Addr *symvals,
+			unsigned *exports, unsigned *nexports,
+			unsigned *imports, unsigned *nimports)
 {
-	char *name;
+	const char *name;
 	unsigned char type, bind;
-	unsigned int i, num = sechdrs[symindex].sh_size / sizeof(Elf32_Sym);
-	Elf32_Sym *sym = (Elf32_Sym *)sechdrs[symindex].sh_addr;
+	unsigned int i, shndx, num = sechdrs[symindex].sh_size / sizeof(Elf32_Sym);
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[symindex].sh_addr;
 
 	TRACE("%d total symbols\n", num);
+	*nexports = 0;
+	*nimports = 0;
 	for (i = 1; i < num; i++) {//ignore the first one entry
 		type = ELF_ST_TYPE (sym[i].st_info);
 		bind = ELF_ST_BIND (sym[i].st_info);
 		name = strtab + sym[i].st_name;
+		shndx = sym_shndx(sym, i, xindex);
 		TRACE("%d symbol: %s---", i, name);
 		switch (type) {
-		case STT_SECTION:
 		case STT_FILE:
 			TRACE("Do nothing\n");
-			break;
-		case STT_NOTYPE://extern symbol
-			if (sym[i].st_name != 0 && sym[i].st_shndx == 0) {
-				TRACE("extern symbol\n");
-				sym[i].st_value = lookup_global_symbol(name);
-				if (!sym[i].st_value) {
-					ERROR("Unknown symbol: %s\n", name);
-					exit(-1);
-				}
-			}	
-			break;
+			continue;
+		case STT_NOTYPE:
 		case STT_OBJECT:
-			TRACE("internal data symbol\n");
-			sym[i].st_value += sechdrs[sym[i].st_shndx].sh_addr;
-			if (bind == STB_GLOBAL)
-				add_global_symbol(si, name, sym[i].st_value);
-			break;
 		case STT_FUNC:
-			TRACE("internal function symbol\n");
-			sym[i].st_value += sechdrs[sym[i].st_shndx].sh_addr;
-			if (bind == STB_GLOBAL)
-				add_global_symbol(si, name, sym[i].st_value);
-			break;			
+		case STT_SECTION:
+			break;
 		default:
 			ERROR("Unknow type %d\n", type);
-			exit(-1);
-			break;
+			return -1;
+		}
+		if (shndx == SHN_UNDEF) {
+			if (sym[i].st_name != 0) {
+				TRACE("extern symbol\n");
+				imports[(*nimports)++] = i;
+			}
+			continue;
+		}
+		if (shndx == SHN_ABS) {
+			TRACE("absolute symbol\n");
+			symvals[i] = sym[i].st_value;
+		} else if (shndx == SHN_COMMON) {
+			/* placed in the bss, see layout_commons() */
+			TRACE("common symbol\n");
+		} else if (shndx >= shnum) {
+			ERROR("symbol %s in bad section %u\n", name, shndx);
+			return -1;
+		} else if (sechdrs[shndx].sh_addr == 0) {
+			/* defined by the copy of the group already loaded */
+			if (bind != STB_LOCAL &&
+				(sechdrs[shndx].sh_flags & SHF_GROUP)) {
+				TRACE("in a COMDAT group loaded before\n");
+				imports[(*nimports)++] = i;
+				continue;
+			}
+			TRACE("in a section that is not loaded\n");
+			continue;
+		} else {
+			TRACE("internal symbol\n");
+			symvals[i] = sym[i].st_value + sechdrs[shndx].sh_addr;
+		}
+		/* weak definitions in groups too, other modules bind to them */
+		if (type != STT_SECTION && (bind == STB_GLOBAL ||
+			(bind == STB_WEAK && shndx < shnum &&
+			 (sechdrs[shndx].sh_flags & SHF_GROUP))))
+			exports[(*nexports)++] = i;
+	}
+	return 0;
+}
+
+//look up the undefined symbols in the global namespace
+//weak ones that are nowhere to be found are left 0
+//those marked in lazy[], if given, are bound on first call instead
+static int resolve_imports(const Elf32_Sym *sym, const char *strtab,
+			Elf32_Addr *symvals, unsigned *imports, unsigned n,
+			const unsigned char *lazy)
+{
+	const char *name;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		if (lazy && lazy[imports[i]])
+			continue;
+		name = strtab + sym[imports[i]].st_name;
+		symvals[imports[i]] = lookup_global_symbol(name);
+		if (!symvals[imports[i]] &&
+			ELF_ST_BIND(sym[imports[i]].st_info) != STB_WEAK) {
+			ERROR("Unknown symbol: %s\n", name);
+			return -1;
 		}
 	}
+	return 0;
 }
 
+/* Relocations that may refer to merged contents, see merge_sections() */
+#if defined(__i386__)
+#define MERGE_RELOC_OK(type)	((type) == R_386_32)
+#elif defined(__sparc__)
+#define MERGE_RELOC_OK(type)	((type) == R_SPARC_HI22 || \
+				 (type) == R_SPARC_LO10 || (type) == R_SPARC_UA32)
+#else
+#define MERGE_RELOC_OK(type)	0
+#endif
+
+struct dl_load;
+#if defined(__i386__) || defined(__sparc__)
+static int merged_value(struct dl_load *ld, unsigned sym, Elf32_Addr addend,
+			Elf32_Addr *value);
+#endif
+
 #ifdef __i386__
 static int
-do_relocate(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
+do_relocate(struct dl_load *ld, Elf32_Shdr *sechdrs, Elf32_Addr *symvals,
+	unsigned int relsec)
 {
 	int i, num;
-	uint32_t *where;
-	Elf32_Sym *sym;
-	Elf32_Rel *rel = (void *)sechdrs[relsec].sh_addr;
+	uint32_t *where, symval;
+	Elf32_Addr merged;
+	const Elf32_Rel *rel = (const void *)sechdrs[relsec].sh_addr;
 
 	num = sechdrs[relsec].sh_size/sizeof(*rel);
 	TRACE("%d relocations\n", num);
@@ -323,17 +626,21 @@ do_relocate(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
 		TRACE("[%d rel] sym=%d offset=0x%x\n", i, ELF32_R_SYM(rel[i].r_info), rel[i].r_offset);
 		where = (void *)sechdrs[sechdrs[relsec].sh_info].sh_addr
 			+ rel[i].r_offset;
-		sym = (Elf32_Sym *)sechdrs[symindex].sh_addr + ELF32_R_SYM(rel[i].r_info);
+		symval = symvals[ELF32_R_SYM(rel[i].r_info)];
 
 		switch (ELF32_R_TYPE(rel[i].r_info)) {
 		case R_386_32://s+a
 			TRACE("R_386_32\n");
-			*where += sym->st_value;
+			if (merged_value(ld, ELF32_R_SYM(rel[i].r_info), *where,
+					&merged))
+				*where = merged;
+			else
+				*where += symval;
 			break;
 		case R_386_PC32://s+a-p
 			TRACE("R_386_PC32\n");
 			/* Add the value, subtract its postition */
-			*where += sym->st_value - (uint32_t)where;
+			*where += symval - (uint32_t)where;
 			break;
 		default:
 			ERROR("unknown/unsupported relocation type: %x\n",
@@ -346,7 +653,8 @@ do_relocate(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
 }
 
 static int
-do_relocate_addend(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
+do_relocate_addend(struct dl_load *ld, Elf32_Shdr *sechdrs, Elf32_Addr *symvals,
+	unsigned int relsec)
 {
 	ERROR("RELA relocation unsupported\n");
 	return -1;
@@ -355,18 +663,19 @@ do_relocate_addend(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int rels
 
 #ifdef __sparc__
 static int
-do_relocate(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
+do_relocate(struct dl_load *ld, Elf32_Shdr *sechdrs, Elf32_Addr *symvals,
+	unsigned int relsec)
 {
-	ERROR("RELA relocation unsupported\n");
+	ERROR("REL relocation unsupported\n");
 	return -1;
 }
 
 static int
-do_relocate_addend(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int relsec)
+do_relocate_addend(struct dl_load *ld, Elf32_Shdr *sechdrs, Elf32_Addr *symvals,
+	unsigned int relsec)
 {
 	int i, num;
-	Elf32_Rela *rel = (void *)sechdrs[relsec].sh_addr;
-	Elf32_Sym *sym;
+	const Elf32_Rela *rel = (const void *)sechdrs[relsec].sh_addr;
 	uint8_t *location;
 	uint32_t *where, v;
 	
@@ -380,8 +689,9 @@ do_relocate_addend(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int rels
 			+ rel[i].r_offset;
 		where = (uint32_t *)location;
 
-		sym = (Elf32_Sym *)sechdrs[symindex].sh_addr + ELF32_R_SYM(rel[i].r_info);
-		v = sym->st_value + rel[i].r_addend;
+		if (!merged_value(ld, ELF32_R_SYM(rel[i].r_info),
+				rel[i].r_addend, &v))
+			v = symvals[ELF32_R_SYM(rel[i].r_info)] + rel[i].r_addend;
 
 		/*refer http://docs.sun.com for SPARC 32 relocation types*/
 		switch (ELF32_R_TYPE(rel[i].r_info) & 0xff) {
@@ -431,245 +741,3433 @@ do_relocate_addend(Elf32_Shdr *sechdrs, unsigned int symindex, unsigned int rels
 }
 #endif
 
-static soinfo *
-load_library(const char *name)
+/* A module on its way in.  prepare_library() does everything that only
+ * depends on the object file: reading and parsing it, copying the image,
+ * defining its own symbols and building its export table.  It touches no
+ * loader state, so it runs without the loader lock and for several
+ * objects at once.  link_libraries() then brings the modules in.
+ *
+ * The load itself and all its scratch live in its arena; only the image
+ * and the export table outlast it.
+ */
+struct dl_load
 {
-	int fd = open_library(name);
-	int i, cnt;
-	soinfo *si = NULL;
-	Elf32_Ehdr hdr;
-	Elf32_Shdr *sechdrs, *p;
-	char *sname, *q, *shstrtbl, *strtab;
-	int totalsize = 0;
-	unsigned int symindex = 0;
+	struct dl_arena arena;
+	char name[SOINFO_NAME_LEN];
+	struct elf_object obj;
+	const Elf32_Ehdr *hdr;
+	Elf32_Shdr *sechdrs;
+	unsigned shnum;
+	const char *shstrtbl;
+	const char *strtab;
+	unsigned symindex, nsyms;
+	const Elf32_Word *xindex;	/* SHT_SYMTAB_SHNDX, if any */
+	unsigned char *keep;	/* sections kept by gc_sections() */
+	signed char *regions;	/* of the sections, see classify_sections() */
+	unsigned *order;	/* of the sections, see order_sections() */
+	unsigned char *hot;	/* sections with profiled functions */
+	Elf32_Addr *symvals;
+	unsigned *imports, nimports;
+	unsigned layout;	/* DL_LAYOUT_* at the start of the load */
+	char *image;
+	size_t image_size;
+	size_t image_align;
+	size_t image_pad;	/* alignment and padding, see layout_image() */
+	char *text[NTEXTS];	/* text apart from the image, see region_piece() */
+	size_t text_size[NTEXTS];
+	char *bss;		/* bss apart from the image, if bss_mapped */
+	size_t bss_size;
+	int bss_mapped;
+	Elf32_Addr *commons;	/* offsets of COMMON symbols in the bss */
+	struct merge_map **merges;	/* of merged sections, see merge_sections() */
+	struct dl_merge_entry **merged;	/* references into the merge pool */
+	unsigned nmerged;
+	struct comdat *comdats;	/* COMDAT groups, see comdat_groups() */
+	unsigned ncomdats, ndropped;
+	struct fold *folds;	/* function sections, see fold_sections() */
+	unsigned nfolds, nfolded;
+	unsigned *relsecs, *nextrel;	/* of each section, see fold_key() */
+	const char **needs;	/* modules autoloaded for it, see autoload_deps() */
+	unsigned nneeds;
+	int bind_lazy;		/* RTLD_LAZY */
+	struct dl_lazy *lazy;	/* the stub table, see lazy_imports() */
+	int replaceable;	/* RTLD_REPLACEABLE */
+	unsigned *funcs;	/* the exported functions, see make_trampolines() */
+	unsigned nfuncs;
+	unsigned char *lazysym;	/* imports bound on first call */
+	unsigned *lazysyms;	/* the import of each stub */
+	size_t stub_off, slot_off;	/* in the text and the data */
+	Elf32_Addr *offsets;	/* of the sections in their piece */
+	int mapped;		/* image is mmap()ed, see alloc_image() */
+	int pooled;		/* image and text are from the pools */
+	struct dl_exports *exports;
+	soinfo *si;
+	unsigned long unloads;	/* dl_unloads when imports were resolved */
+	int relocated;
+	int prelinked;		/* image came relocated from the cache */
+	uint64_t key;		/* prelink cache key */
+};
+
+#ifdef DL_POOLS
+static struct dl_pool textpools[NTEXTS] = {
+	[TEXT_STARTUP] = DL_POOL_INIT("startup", DL_PAGE_SIZE, 1),
+	[TEXT_HOT] = DL_POOL_INIT("hot", DL_PAGE_SIZE, 1),
+	[TEXT_NORMAL] = DL_POOL_INIT("text", DL_PAGE_SIZE, 1),
+	[TEXT_COLD] = DL_POOL_INIT("cold", DL_PAGE_SIZE, 1),
+};
+static struct dl_pool datapool = DL_POOL_INIT("data", DL_CACHELINE, 0);
+#endif
 
-	if(fd == -1)
+/* A piece of text apart from the image, see region_piece(): from its
+ * pool, or for the startup code of a module that is not pooled, from
+ * the heap.
+ */
+static char *alloc_text(struct dl_load *ld, int t)
+{
+	size_t align = ld->image_align;
+	char *text;
+
+#ifdef DL_POOLS
+	if (ld->pooled)
+		return dl_pool_alloc(&textpools[t], ld->text_size[t], align);
+#endif
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+	if (posix_memalign((void **)&text, align, ld->text_size[t]))
 		return NULL;
+	memset(text, 0, ld->text_size[t]);
+	return text;
+}
 
-	/* We have to read the ELF header to figure out what to do with this image
-	*/
-	TRACE("loading elf header...\n");
-	if (lseek(fd, 0, SEEK_SET) < 0) {
-		ERROR("lseek() failed!\n");
-		goto fail;
-	}
-	if ((cnt = read(fd, &hdr, sizeof(hdr))) < 0) {
-		ERROR("read() failed!\n");
-		goto fail;
-	}
-	if (verify_elf_object(&hdr, name) < 0) {
-        	ERROR("%s is not a valid ELF object\n", name);
-		goto fail;
+static void free_text(char *text, size_t size, int t, int pooled)
+{
+#ifdef DL_POOLS
+	if (pooled) {
+		dl_pool_free(&textpools[t], text, size);
+		return;
 	}
+#endif
+	free(text);
+}
 
-	si = alloc_info(name);
-	if (si == NULL)
-		goto fail;
+/* Images are mapped when prelinking, so that a later process can ask for
+ * the same address again.  With DL_LAYOUT_POOL the text and the rest of
+ * the image come from the pools instead.  The pieces of text are
+ * allocated here too.
+ */
+static char *alloc_image(struct dl_load *ld, size_t size)
+{
+	char *image;
+	int t;
 
-	TRACE("loading %d section headers...\n", hdr.e_shnum);
-	sechdrs = calloc(sizeof(Elf32_Shdr), hdr.e_shnum);
-	if (sechdrs == NULL) {
-		ERROR("calloc failed!\n");
-		goto fail;
-	}
-	if (lseek(fd, hdr.e_shoff, SEEK_SET) < 0) {
-		ERROR("lseek() failed!\n");
-		goto fail;
-	}
-	i = hdr.e_shnum * sizeof(*sechdrs);
-	if (read(fd, sechdrs, i) != i) {
-		ERROR("read failed!\n");
-		goto fail;
-	}
-	
-	TRACE("loading section name string table...\n");
-	p = sechdrs + hdr.e_shstrndx;
-	shstrtbl = calloc(p->sh_size, 1);
-	if (shstrtbl == NULL) {
-		ERROR("calloc failed!\n");
-		goto fail;
-	}
-	if (lseek(fd, p->sh_offset, SEEK_SET) < 0) {
-		ERROR("lseek() failed!\n");
-		goto fail;
-	}
-	if (read(fd, shstrtbl, p->sh_size) != p->sh_size) {
-		ERROR("read failed!\n");
-		goto fail;
+	ld->image_size = size;
+	ld->pooled = (ld->layout & DL_LAYOUT_POOL) != 0;
+	for (t = 0; t < NTEXTS; t++) {
+		if (ld->text_size[t] == 0)
+			continue;
+		/* discard_library() frees what was allocated */
+		ld->text[t] = alloc_text(ld, t);
+		if (ld->text[t] == NULL)
+			return NULL;
 	}
-
-	TRACE("collecting info of needed sections...\n");
-	for (i = 0; i < hdr.e_shnum; i++) {
-		p = sechdrs + i;
-		sname = shstrtbl + p->sh_name;
-		switch (p->sh_type) {
-			case SHT_PROGBITS:
-				if (!strcmp(sname,".data") ||
-					!strcmp(sname,".text")) {
-					totalsize += p->sh_size;
-					TRACE("section:%s %uB bytes\n", sname, p->sh_size);
-				}
-				break;
-			case SHT_NOBITS:
-				TRACE("section:%s %uB bytes\n", sname, p->sh_size);
-				totalsize += p->sh_size;
-				break;
-			case SHT_SYMTAB:
-				TRACE("section:%s %dB bytes\n", sname, p->sh_size);
-				totalsize += p->sh_size;
-				break;
-			case SHT_RELA:
-			case SHT_REL:
-				if (!strcmp(sname,".rel.data") ||
-					!strcmp(sname,".rel.text") || 
-					!strcmp(sname,".rela.data") ||
-					!strcmp(sname,".rela.text")) {
-					TRACE("section:%s %uB bytes\n", sname, p->sh_size);
-					totalsize += p->sh_size;
-				}
-				break;
+#ifdef DL_USE_MMAP
+	/* demand zero, untouched pages cost nothing */
+	if (ld->bss_mapped) {
+		ld->bss = mmap(NULL, ld->bss_size ? ld->bss_size : 1,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ld->bss == MAP_FAILED) {
+			ld->bss = NULL;
+			return NULL;
 		}
 	}
-	q = si->image = calloc(1, totalsize);
-	if (q == NULL) {
-		ERROR("calloc failed!\n");
-		goto fail;
+#endif
+#ifdef DL_POOLS
+	if (ld->pooled)
+		return dl_pool_alloc(&datapool, size, ld->image_align);
+#endif
+#ifdef DL_PRELINK
+	if (prelink_enabled()) {
+		image = mmap(NULL, size ? size : 1,
+				PROT_READ | PROT_WRITE | PROT_EXEC,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (image == MAP_FAILED)
+			return NULL;
+		ld->mapped = 1;
+		return image;
 	}
-	TRACE("need to load %dB bytes\n", totalsize);
-	TRACE("loading needed sections...\n");
-	for (i = 0; i < hdr.e_shnum; i++) {
-		p = sechdrs + i;
-		sname = shstrtbl + p->sh_name;
-		TRACE("check section: %s\n", sname);
-		switch (p->sh_type) {
-			case SHT_PROGBITS:
-				if (!strcmp(sname,".data") ||
-					!strcmp(sname,".text")){
-					TRACE("loading section: %s\n", sname);
-					elf_loadsection(fd, p, q);
-					p->sh_addr = (unsigned long)q;
-					q += p->sh_size;
-				}
-				break;
-			case SHT_NOBITS:
-				TRACE("loading section: %s\n", sname);
-				elf_loadsection(fd, p, q);
-				p->sh_addr = (unsigned long)q;
-				q += p->sh_size;
-				break;
-			case SHT_SYMTAB:
-				TRACE("loading section: %s\n", sname);
-				symindex = i;
-				elf_loadsection(fd, p, q);
-				p->sh_addr = (unsigned long)q;
-				q += p->sh_size;
-				strtab = malloc(sechdrs[p->sh_link].sh_size);
-				TRACE("string size: %u\n", sechdrs[p->sh_link].sh_size);
-				elf_loadsection(fd, &sechdrs[p->sh_link], strtab);
-				sechdrs[p->sh_link].sh_addr = (unsigned long)strtab;
-				break;
-			case SHT_RELA:
-			case SHT_REL:
-				if (!strcmp(sname,".rel.data") ||
-					!strcmp(sname,".rel.text") ||
-					!strcmp(sname,".rela.data") ||
-					!strcmp(sname,".rela.text")) {
-					TRACE("loading section: %x %s\n", p->sh_name, sname);
-					elf_loadsection(fd, p, q);
-					p->sh_addr = (unsigned long)q;
-					q += p->sh_size;
-					TRACE("%d-----%p\n", i, q);
-				}
-				break;
-		}
+#endif
+	if (ld->image_align <= 2 * sizeof(void *))
+		return calloc(1, size);
+	if (posix_memalign((void **)&image, ld->image_align, size ? size : 1))
+		return NULL;
+	memset(image, 0, size);
+	return image;
+}
+
+static void free_image(char *image, size_t size, int mapped)
+{
+#ifdef DL_PRELINK
+	if (mapped) {
+		munmap(image, size ? size : 1);
+		return;
 	}
+#endif
+	free(image);
+}
 
-	TRACE("resolving symbols...\n");
-	resolve_symbols(sechdrs, symindex, strtab, si);
+/* The image of a module that is going away, after free_info() has taken
+ * its exports out; lookups may have found something in it just now.
+ */
+#ifdef DL_LAZY
+static void free_stubs(struct dl_lazy *lazy);
+#endif
 
-	//relocation
-	TRACE("relocating...\n");
-	for (i = 1; i < hdr.e_shnum; i++) {
-		sname = shstrtbl + sechdrs[i].sh_name;
-		if (sechdrs[i].sh_type == SHT_REL) {
-			if (!strcmp(sname,".rel.data") ||
-				!strcmp(sname,".rel.text")) {
-				TRACE("SHT_REL relocate %s\n", sname);
-				if (do_relocate(sechdrs, symindex, i))
-					goto fail;
-			}
-		}
-		else if (sechdrs[i].sh_type == SHT_RELA) {
-			if (!strcmp(sname,".rela.data") ||
-				!strcmp(sname,".rela.text")) {
-				TRACE("SHT_REL relocate %s\n", sname);
-				if (do_relocate_addend(sechdrs, symindex, i))
-					goto fail;
-			}
-		}
-	}
-	TRACE("DONE\n");
-  
-	close(fd);
-	return si;
+static void release_image(soinfo *si)
+{
+	unsigned i;
+	int t;
 
-fail:
-	if (si) free_info(si);
-		close(fd);
-	return NULL;
+	if (si->image == NULL)
+		return;
+	if ((si->flags & (FLAG_MAPPED | FLAG_POOLED)) || si->bss || si->merged ||
+		si->lazy || si->tramps)
+		dl_synchronize();
+	free(si->lazy);
+	si->lazy = NULL;
+#ifdef DL_LAZY
+	free_stubs(si->tramps);
+	si->tramps = NULL;
+#endif
+	for (i = 0; i < si->nmerged; i++)
+		dl_merge_put(si->merged[i]);
+	free(si->merged);
+	si->merged = NULL;
+	si->nmerged = 0;
+#ifdef DL_USE_MMAP
+	if (si->bss)
+		munmap(si->bss, si->bss_size ? si->bss_size : 1);
+	si->bss = NULL;
+#endif
+	for (t = 0; t < NTEXTS; t++) {
+		if (si->text[t])
+			free_text(si->text[t], si->text_size[t], t,
+				(si->flags & FLAG_POOLED) != 0);
+		si->text[t] = NULL;
+	}
+#ifdef DL_POOLS
+	if (si->flags & FLAG_POOLED)
+		dl_pool_free(&datapool, si->image, si->image_size);
+	else
+#endif
+	if (si->flags & FLAG_MAPPED)
+		free_image(si->image, si->image_size, 1);
+	else
+		dl_defer_free(si->image);
+	si->image = NULL;
 }
 
-soinfo *find_library(const char *name)
+void discard_library(struct dl_load *ld)
 {
-	soinfo *si;
+	struct dl_arena arena = ld->arena;
+	unsigned i;
+	int t;
 
-	for(si = solist; si != 0; si = si->next){
-		if(!strcmp(name, si->name)) {
-			if(si->flags & FLAG_ERROR) return 0;
-			if(si->flags & FLAG_LINKED) return si;
-			ERROR("OOPS: recursive link to '%s'\n", si->name);
-			return 0;
-		}
+	elf_unmap(&ld->obj);
+	for (i = 0; i < ld->nmerged; i++)
+		dl_merge_put(ld->merged[i]);
+	free(ld->merged);
+	free(ld->lazy);
+#ifdef DL_USE_MMAP
+	if (ld->bss)
+		munmap(ld->bss, ld->bss_size ? ld->bss_size : 1);
+#endif
+	for (t = 0; t < NTEXTS; t++) {
+		if (ld->text[t])
+			free_text(ld->text[t], ld->text_size[t], t, ld->pooled);
 	}
-
-	TRACE("[ '%s' has not been loaded yet.  Locating...]\n", name);
-	si = load_library(name);
-	if(si == NULL)
-		return NULL;
-//	return init_library(si);
-	return si;
+#ifdef DL_POOLS
+	if (ld->pooled && ld->image)
+		dl_pool_free(&datapool, ld->image, ld->image_size);
+	else
+#endif
+	if (ld->image)
+		free_image(ld->image, ld->image_size, ld->mapped);
+	free(ld->exports);
+	dl_arena_free(&arena);
 }
 
-unsigned unload_library(soinfo *si)
+/* The image is laid out in regions: startup, hot, normal and cold text,
+ * then data and bss.  The text regions are numbered like the pieces of
+ * text in linker.h.
+ */
+enum {
+	REGION_STARTUP = TEXT_STARTUP,
+	REGION_HOT = TEXT_HOT,
+	REGION_TEXT = TEXT_NORMAL,
+	REGION_COLD = TEXT_COLD,
+	REGION_DATA,
+	REGION_BSS,
+	NREGIONS
+};
+#define region_is_text(r)	((unsigned)(r) < NTEXTS)
+
+static const char *region_names[NREGIONS] = {
+	"startup", "hot", "text", "cold", "data", "bss"
+};
+
+/* The text partitions GCC emits, .text.hot.foo and the like */
+static int text_partition(const char *sname)
 {
-	if (si->refcount == 1) {
-		free_info(si);
-		si->refcount = 0;
-	} else {
-		si->refcount--;
-		PRINT("not unloading '%s', decrementing refcount to %d\n",
-			si->name, si->refcount);
+	static const struct {
+		const char *prefix;
+		int region;
+	} parts[] = {
+		{ ".text.startup", REGION_STARTUP },
+		{ ".text.hot", REGION_HOT },
+		{ ".text.unlikely", REGION_COLD },
+		{ NULL, 0 }
+	};
+	size_t len;
+	int i;
+
+	for (i = 0; parts[i].prefix; i++) {
+		len = strlen(parts[i].prefix);
+		if (!strncmp(sname, parts[i].prefix, len) &&
+			(sname[len] == '\0' || sname[len] == '.'))
+			return parts[i].region;
 	}
-	return si->refcount;
+	return REGION_TEXT;
 }
 
-//read the core sym and initialize
-void __linker_init(char *filename)
+/* Every allocatable section is loaded, whatever its name, unless
+ * gc_sections() dropped it.  .eh_frame is left out, there is no unwinder
+ * to register it with.  Hot, cold and startup text go into regions of
+ * their own; startup code is freed once the constructors have run, so a
+ * startup section defining a global symbol counts as normal text.
+ */
+static int classify_sections(struct dl_load *ld)
 {
-	gzFile gzfile;
-	char buf[BUFSIZ/2];
-	char otype, *rest;
-	unsigned long val;
-	int count = 0;
-	struct dl_symbol *entry;
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	const Elf32_Shdr *p;
+	size_t bss = 0;
+	unsigned i, s, ncommons = 0;
+	int r;
 
-	if (cexpSystemSymbols) {
-		syssyms = cexpSystemSymbols;
+	ld->regions = dl_arena_alloc(&ld->arena, ld->shnum);
+	if (ld->regions == NULL)
+		return -1;
+	for (i = 0; i < ld->shnum; i++) {
+		p = ld->sechdrs + i;
+		r = -1;
+		if (!(p->sh_flags & SHF_ALLOC) || (ld->keep && !ld->keep[i])) {
+			ld->regions[i] = r;
+			continue;
+		}
+		switch (p->sh_type) {
+		case SHT_PROGBITS:
+			if (!strcmp(ld->shstrtbl + p->sh_name, ".eh_frame"))
+				break;
+			/* fall through */
+		case SHT_INIT_ARRAY:
+		case SHT_FINI_ARRAY:
+		case SHT_PREINIT_ARRAY:
+			if (p->sh_flags & SHF_EXECINSTR)
+				r = text_partition(ld->shstrtbl + p->sh_name);
+			else
+				r = REGION_DATA;
+			break;
+		case SHT_NOBITS:
+			r = REGION_BSS;
+			bss += p->sh_size;
+			break;
+		}
+		ld->regions[i] = r;
+	}
+	for (i = 1; i < ld->nsyms; i++) {
+		if (ELF_ST_BIND(sym[i].st_info) == STB_LOCAL)
+			continue;
+		s = sym_shndx(sym, i, ld->xindex);
+		if (s == SHN_COMMON) {
+			bss += sym[i].st_size;
+			ncommons++;
+		}
+		if (s < ld->shnum && ld->regions[s] == REGION_STARTUP)
+			ld->regions[s] = REGION_TEXT;
+	}
+	if (ncommons) {
+		ld->commons = dl_arena_alloc(&ld->arena,
+				ld->nsyms * sizeof(Elf32_Addr));
+		if (ld->commons == NULL)
+			return -1;
+	}
+#ifdef DL_USE_MMAP
+	ld->bss_mapped = bss >= DL_BSS_MAP;
+#endif
+	return 0;
+}
+
+/* Where the pieces of a merged section went, see merge_sections() */
+struct merge_piece
+{
+	Elf32_Addr off;		/* in the section */
+	Elf32_Addr addr;	/* of the pooled copy */
+};
+
+struct merge_map
+{
+	unsigned n;
+	struct merge_piece pieces[1];
+};
+
+/* A COMDAT group of a module and whether a copy was loaded before */
+struct comdat
+{
+	const char *sig;	/* the signature, in the object */
+	uint32_t hash;
+	unsigned sec;		/* the SHT_GROUP section */
+	int dropped;
+};
+
+/* The members of the group in section i */
+#define GROUP_MEMBERS(ld, i)	((const Elf32_Word *)((ld)->obj.base + \
+				(ld)->sechdrs[i].sh_offset) + 1)
+#define GROUP_COUNT(ld, i)	((ld)->sechdrs[i].sh_size / sizeof(Elf32_Word) - 1)
+
+static int is_comdat(struct dl_load *ld, const Elf32_Shdr *p)
+{
+	return p->sh_type == SHT_GROUP && p->sh_link == ld->symindex &&
+		p->sh_info < ld->nsyms && p->sh_size >= sizeof(Elf32_Word) &&
+		(*(const Elf32_Word *)(ld->obj.base + p->sh_offset) & GRP_COMDAT);
+}
+
+/* COMDAT groups hold C++ template instances, inline functions and the
+ * like.  The first module to load a group keeps it, later ones do not
+ * load their copy: its global symbols are looked up instead, binding
+ * them to the kept one, see define_symbols().  A copy referred to
+ * through local symbols from outside the group is loaded after all.
+ * link_groups() checks again under the loader lock.
+ */
+static int comdat_groups(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs, *p;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	const Elf32_Word *members;
+	const Elf32_Rel *rel;
+	struct comdat *g;
+	unsigned *group;	/* of each section, index + 1 */
+	unsigned i, j, k, s, t, num, n = 0;
+	size_t entsize, bytes = 0;
+	int changed;
+
+	for (i = 1; i < ld->shnum; i++)
+		n += is_comdat(ld, sechdrs + i);
+	if (n == 0)
+		return 0;
+	ld->comdats = dl_arena_calloc(&ld->arena, n, sizeof(*ld->comdats));
+	group = dl_arena_calloc(&ld->arena, ld->shnum, sizeof(unsigned));
+	if (ld->comdats == NULL || group == NULL)
+		return -1;
+
+	dl_read_lock();
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if (!is_comdat(ld, p))
+			continue;
+		g = &ld->comdats[ld->ncomdats++];
+		g->sec = i;
+		k = p->sh_info;
+		s = sym_shndx(sym, k, ld->xindex);
+		if (ELF_ST_TYPE(sym[k].st_info) == STT_SECTION && s < ld->shnum)
+			g->sig = ld->shstrtbl + sechdrs[s].sh_name;
+		else
+			g->sig = ld->strtab + sym[k].st_name;
+		g->hash = dl_gnu_hash(g->sig);
+		g->dropped = symhash_lookup(&comdats, g->sig, g->hash) != NULL;
+		members = GROUP_MEMBERS(ld, i);
+		for (j = 0; j < GROUP_COUNT(ld, i); j++) {
+			if (members[j] < ld->shnum)
+				group[members[j]] = ld->ncomdats;
+		}
+	}
+	dl_read_unlock();
+
+	/* keep the groups that loaded sections refer to by local symbols,
+	 * until no more are found
+	 */
+	do {
+		changed = 0;
+		for (i = 1; i < ld->shnum; i++) {
+			p = sechdrs + i;
+			if ((p->sh_type != SHT_REL && p->sh_type != SHT_RELA) ||
+				(t = p->sh_info) >= ld->shnum || ld->regions[t] < 0 ||
+				(group[t] && ld->comdats[group[t] - 1].dropped))
+				continue;
+			entsize = p->sh_type == SHT_REL ?
+				sizeof(Elf32_Rel) : sizeof(Elf32_Rela);
+			num = p->sh_size / entsize;
+			for (j = 0; j < num; j++) {
+				rel = (const Elf32_Rel *)(p->sh_addr + j * entsize);
+				k = ELF32_R_SYM(rel->r_info);
+				if (k == 0 || k >= ld->nsyms ||
+					ELF_ST_BIND(sym[k].st_info) != STB_LOCAL)
+					continue;
+				s = sym_shndx(sym, k, ld->xindex);
+				if (s < ld->shnum && group[s] &&
+					ld->comdats[group[s] - 1].dropped) {
+					TRACE("keeping group %s, used by %s\n",
+						ld->comdats[group[s] - 1].sig,
+						ld->shstrtbl + sechdrs[t].sh_name);
+					ld->comdats[group[s] - 1].dropped = 0;
+					changed = 1;
+				}
+			}
+		}
+	} while (changed);
+
+	for (i = 1; i < ld->shnum; i++) {
+		if (!group[i] || !ld->comdats[group[i] - 1].dropped)
+			continue;
+		if (ld->regions[i] >= 0)
+			bytes += sechdrs[i].sh_size;
+		ld->regions[i] = -1;
+	}
+	for (i = 0; i < ld->ncomdats; i++)
+		ld->ndropped += ld->comdats[i].dropped;
+	INFO("%s: %u of %u COMDAT groups loaded before, %lu bytes not loaded\n",
+		ld->name, ld->ndropped, ld->ncomdats, (unsigned long)bytes);
+	return 0;
+}
+
+/* Record that si uses the code of owner, see link_libraries() */
+static void hold_owner(soinfo *si, const void *owner)
+{
+	unsigned i;
+
+	for (i = 0; i < si->nowners; i++) {
+		if (si->owners[i] == owner)
+			return;
+	}
+	si->owners[si->nowners++] = (soinfo *)owner;
+}
+
+/* Under the loader lock: the groups the module keeps become known, and
+ * the modules holding the ones it did not load are recorded, see
+ * unload_library().  A group that was unloaded since comdat_groups()
+ * fails the link.
+ */
+static int link_groups(struct dl_load *ld, soinfo *si)
+{
+	const struct symhash_entry *e;
+	const Elf32_Word *members;
+	struct comdat *g;
+	size_t size = 0;
+	unsigned i, j, n;
+	char *q;
+
+	if (ld->ncomdats == 0)
+		return 0;
+	for (i = 0; i < ld->ncomdats; i++) {
+		g = &ld->comdats[i];
+		if (!g->dropped) {
+			size += strlen(g->sig) + 1;
+			continue;
+		}
+		e = symhash_lookup(&comdats, g->sig, g->hash);
+		if (e == NULL) {
+			ERROR("%s: COMDAT group %s was unloaded meanwhile\n",
+				ld->name, g->sig);
+			return -1;
+		}
+		hold_owner(si, e->owner);
+	}
+	if (size == 0)
+		return 0;
+
+	si->groups = q = malloc(size);
+	if (si->groups == NULL)
+		return -1;
+	for (i = 0; i < ld->ncomdats; i++) {
+		g = &ld->comdats[i];
+		if (g->dropped || symhash_lookup(&comdats, g->sig, g->hash))
+			continue;
+		/* a group that lost members to gc_sections() is no use to others */
+		members = GROUP_MEMBERS(ld, g->sec);
+		n = GROUP_COUNT(ld, g->sec);
+		for (j = 0; ld->keep && j < n; j++) {
+			if (members[j] < ld->shnum &&
+				(ld->sechdrs[members[j]].sh_flags & SHF_ALLOC) &&
+				!ld->keep[members[j]])
+				break;
+		}
+		if (ld->keep && j < n)
+			continue;
+		strcpy(q, g->sig);
+		if (symhash_insert(&comdats, q, g->hash, 0, si) < 0)
+			return -1;
+		q += strlen(q) + 1;
+		si->ngroups++;
+	}
+	return 0;
+}
+
+/* A function section and the copy it is folded onto, if any */
+struct fold
+{
+	unsigned sec;
+	unsigned alias;		/* the same function in this module */
+	unsigned long addr;	/* the same function in another module */
+	Elf32_Word *key;	/* see fold_key() */
+	size_t size;
+	uint32_t hash;
+};
+
+/* The key of function section i for folding: its size, alignment and
+ * contents, then offset, type, addend and target of every relocation.
+ * Returns its length in words, or 0 if the function refers to something
+ * in its own module or to a symbol that is not there.  Imports must be
+ * resolved, key may be NULL to get the length.
+ */
+static size_t fold_key(struct dl_load *ld, unsigned i, Elf32_Word *key)
+{
+	const Elf32_Shdr *p = ld->sechdrs + i, *rs;
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	const Elf32_Rel *rel;
+	size_t words = 2 + (p->sh_size + 3) / 4, entsize;
+	unsigned r, j, k, s, num;
+
+	if (key) {
+		key[0] = p->sh_size;
+		key[1] = p->sh_addralign;
+		key[words - 1] = 0;
+		memcpy(key + 2, ld->obj.base + p->sh_offset, p->sh_size);
+	}
+	for (r = ld->relsecs[i]; r; r = ld->nextrel[r]) {
+		rs = ld->sechdrs + r;
+		entsize = rs->sh_type == SHT_REL ?
+			sizeof(Elf32_Rel) : sizeof(Elf32_Rela);
+		num = rs->sh_size / entsize;
+		for (j = 0; j < num; j++, words += 4) {
+			rel = (const Elf32_Rel *)(rs->sh_addr + j * entsize);
+			k = ELF32_R_SYM(rel->r_info);
+			if (k >= ld->nsyms)
+				return 0;
+			s = k ? sym_shndx(sym, k, ld->xindex) : SHN_ABS;
+			if (s != SHN_UNDEF && s != SHN_ABS)
+				return 0;
+			if (s == SHN_UNDEF && (sym[k].st_name == 0 ||
+				(!ld->symvals[k] &&
+				 ELF_ST_BIND(sym[k].st_info) != STB_WEAK)))
+				return 0;
+			if (key == NULL)
+				continue;
+			key[words] = rel->r_offset;
+			key[words + 1] = rs->sh_type << 8 | ELF32_R_TYPE(rel->r_info);
+			key[words + 2] = rs->sh_type == SHT_RELA ?
+				((const Elf32_Rela *)rel)->r_addend : 0;
+			key[words + 3] = s == SHN_ABS ?
+				(k ? sym[k].st_value : 0) : ld->symvals[k];
+		}
+	}
+	return words;
+}
+
+/* DL_LAYOUT_FOLD: identical function sections, same code calling the
+ * same functions in other modules, are loaded once.  A function that is
+ * the same as one earlier in the module, or one of a module loaded
+ * before, see dlfold.h, is not loaded; its symbols are defined at the
+ * copy.  Build with -ffunction-sections for this to find anything.
+ */
+static int fold_sections(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs, *p;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	const void *owner;
+	struct fold *f, *g;
+	unsigned *table;	/* of the folds by key, index + 1 */
+	unsigned i, j, n = 0, mask = 1;
+	size_t words, bytes = 0;
+	int r;
+
+	ld->relsecs = dl_arena_calloc(&ld->arena, ld->shnum, sizeof(unsigned));
+	ld->nextrel = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(unsigned));
+	if (ld->relsecs == NULL || ld->nextrel == NULL)
+		return -1;
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if ((p->sh_type == SHT_REL || p->sh_type == SHT_RELA) &&
+			p->sh_info < ld->shnum && p->sh_link == ld->symindex) {
+			ld->nextrel[i] = ld->relsecs[p->sh_info];
+			ld->relsecs[p->sh_info] = i;
+		}
+	}
+
+	/* resolve_library() does this again, these are for the keys */
+	dl_read_lock();
+	for (i = 1; i < ld->nsyms; i++) {
+		if (sym_shndx(sym, i, ld->xindex) == SHN_UNDEF && sym[i].st_name)
+			ld->symvals[i] = lookup_global_symbol(ld->strtab + sym[i].st_name);
+	}
+	dl_read_unlock();
+
+	for (i = 1; i < ld->shnum; i++) {
+		r = ld->regions[i];
+		if (region_is_text(r) && r != REGION_STARTUP &&
+			sechdrs[i].sh_type == SHT_PROGBITS && sechdrs[i].sh_size)
+			n++;
+	}
+	if (n == 0)
+		return 0;
+	while (mask < 2 * n)
+		mask <<= 1;
+	ld->folds = dl_arena_alloc(&ld->arena, n * sizeof(*ld->folds));
+	table = dl_arena_calloc(&ld->arena, mask--, sizeof(unsigned));
+	if (ld->folds == NULL || table == NULL)
+		return -1;
+
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		r = ld->regions[i];
+		if (!region_is_text(r) || r == REGION_STARTUP ||
+			p->sh_type != SHT_PROGBITS || p->sh_size == 0 ||
+			(words = fold_key(ld, i, NULL)) == 0)
+			continue;
+		f = &ld->folds[ld->nfolds];
+		f->sec = i;
+		f->alias = 0;
+		f->addr = 0;
+		f->size = words * sizeof(Elf32_Word);
+		f->key = dl_arena_alloc(&ld->arena, f->size);
+		if (f->key == NULL)
+			return -1;
+		fold_key(ld, i, f->key);
+		f->hash = dl_merge_hash(f->key, f->size);
+
+		for (j = f->hash & mask; table[j]; j = (j + 1) & mask) {
+			g = &ld->folds[table[j] - 1];
+			if (g->hash == f->hash && g->size == f->size &&
+				!memcmp(g->key, f->key, f->size))
+				break;
+		}
+		if (table[j]) {
+			/* the first of its kind, itself kept or folded */
+			f->addr = g->addr;
+			if (f->addr == 0)
+				f->alias = g->sec;
+		} else {
+			table[j] = ld->nfolds + 1;
+			f->addr = dl_fold_find(f->key, f->size, f->hash, &owner);
+		}
+		ld->nfolds++;
+		if (f->alias || f->addr) {
+			TRACE("folding %s\n", ld->shstrtbl + p->sh_name);
+			ld->regions[i] = -1;
+			ld->nfolded++;
+			bytes += p->sh_size;
+		}
+	}
+	INFO("%s: %u of %u functions folded, %lu bytes\n",
+		ld->name, ld->nfolded, ld->nfolds, (unsigned long)bytes);
+	return 0;
+}
+
+/* Under the loader lock, the imports resolved again: the functions the
+ * module loaded become known, and those it folded onto the copies of
+ * other modules are checked, their modules recorded.
+ */
+static int link_folds(struct dl_load *ld, soinfo *si)
+{
+	const void *owner;
+	struct fold *f;
+	unsigned i;
+
+	if (ld->nfolds > ld->nfolded) {
+		si->folds = malloc((ld->nfolds - ld->nfolded) * sizeof(*si->folds));
+		if (si->folds == NULL)
+			return -1;
+	}
+	for (i = 0; i < ld->nfolds; i++) {
+		f = &ld->folds[i];
+		if (f->alias)
+			continue;
+		/* the imports may have moved since fold_sections() */
+		fold_key(ld, f->sec, f->key);
+		if (f->addr) {
+			if (dl_fold_find(f->key, f->size, f->hash, &owner) != f->addr) {
+				ERROR("%s: the copy of %s went away meanwhile\n", ld->name,
+					ld->shstrtbl + ld->sechdrs[f->sec].sh_name);
+				return -1;
+			}
+			hold_owner(si, owner);
+		} else if (!dl_fold_find(f->key, f->size, f->hash, &owner)) {
+			si->folds[si->nfolds] = dl_fold_add(f->key, f->size, f->hash,
+					ld->sechdrs[f->sec].sh_addr, si);
+			if (si->folds[si->nfolds] == NULL)
+				return -1;
+			si->nfolds++;
+		}
+	}
+	return 0;
+}
+
+#ifdef DL_LAZY
+/* RTLD_LAZY: the stubs of the functions a module calls in other modules,
+ * see write_stubs().  The slots are in the data of the module.
+ */
+struct dl_lazy
+{
+	unsigned n;
+	Elf32_Addr *slots;
+	char *stubs;
+	struct dl_plugin *plugin;	/* RTLD_DEFER, see open_plugin() */
+	struct dl_lazy *next;	/* trampolines of earlier versions */
+	const char *names[1];	/* the strings follow */
+};
+
+#define STUB_SIZE	16
+
+/* A call or jump, rel32 at loc */
+static int is_branch(const unsigned char *loc, Elf32_Addr off)
+{
+	return loc[-1] == 0xe8 || loc[-1] == 0xe9 ||
+		(off >= 2 && loc[-2] == 0x0f && (loc[-1] & 0xf0) == 0x80);
+}
+
+/* Imports only called or jumped to from text are bound lazily, anything
+ * else that refers to them (taking the address, data) is bound when the
+ * module is loaded, as are weak imports and those of functions that may
+ * be folded, see fold_key().
+ */
+static int lazy_imports(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs, *p, *t;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	const Elf32_Rel *rel;
+	unsigned char *state;	/* 1 called only, 2 bound at load */
+	unsigned i, j, k, r, num, n = 0;
+	size_t size, entsize;
+	char *q;
+
+	state = dl_arena_calloc(&ld->arena, ld->nsyms, 1);
+	if (state == NULL)
+		return -1;
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if (p->sh_type != SHT_REL || p->sh_link != ld->symindex ||
+			p->sh_info >= ld->shnum || ld->regions[p->sh_info] < 0)
+			continue;
+		t = sechdrs + p->sh_info;
+		rel = (const Elf32_Rel *)p->sh_addr;
+		num = p->sh_size / sizeof(*rel);
+		for (j = 0; j < num; j++) {
+			k = ELF32_R_SYM(rel[j].r_info);
+			if (k == 0 || k >= ld->nsyms || sym[k].st_name == 0 ||
+				sym_shndx(sym, k, ld->xindex) != SHN_UNDEF)
+				continue;
+			if (ELF32_R_TYPE(rel[j].r_info) == R_386_PC32 &&
+				(t->sh_flags & SHF_EXECINSTR) &&
+				rel[j].r_offset >= 1 && rel[j].r_offset + 4 <= t->sh_size &&
+				is_branch((const unsigned char *)ld->obj.base +
+					t->sh_offset + rel[j].r_offset, rel[j].r_offset) &&
+				ELF_ST_BIND(sym[k].st_info) != STB_WEAK && state[k] != 2)
+				state[k] = 1;
+			else
+				state[k] = 2;
+		}
+	}
+	for (i = 0; i < ld->nfolds; i++) {
+		for (r = ld->relsecs[ld->folds[i].sec]; r; r = ld->nextrel[r]) {
+			p = sechdrs + r;
+			entsize = p->sh_type == SHT_REL ?
+				sizeof(Elf32_Rel) : sizeof(Elf32_Rela);
+			num = p->sh_size / entsize;
+			for (j = 0; j < num; j++) {
+				rel = (const Elf32_Rel *)(p->sh_addr + j * entsize);
+				k = ELF32_R_SYM(rel->r_info);
+				if (k < ld->nsyms)
+					state[k] = 2;
+			}
+		}
+	}
+
+	size = 0;
+	for (k = 1; k < ld->nsyms; k++) {
+		if (state[k] == 1) {
+			n++;
+			size += strlen(ld->strtab + sym[k].st_name) + 1;
+		}
+	}
+	TRACE("%u imports bound lazily\n", n);
+	if (n == 0)
+		return 0;
+	ld->lazysym = state;
+	ld->lazysyms = dl_arena_alloc(&ld->arena, n * sizeof(unsigned));
+	ld->lazy = calloc(1, sizeof(*ld->lazy) + (n - 1) * sizeof(char *) +
+			size);
+	if (ld->lazysyms == NULL || ld->lazy == NULL) {
+		ERROR("calloc failed!\n");
+		return -1;
+	}
+	ld->lazy->n = n;
+	q = (char *)&ld->lazy->names[n];
+	for (k = 1, j = 0; k < ld->nsyms; k++) {
+		if (state[k] != 1) {
+			state[k] = 0;
+			continue;
+		}
+		strcpy(q, ld->strtab + sym[k].st_name);
+		ld->lazy->names[j] = q;
+		q += strlen(q) + 1;
+		ld->lazysyms[j++] = k;
+	}
+	return 0;
+}
+
+Elf32_Addr dl_lazy_bind(struct dl_lazy *lazy, unsigned j);
+void dl_lazy_entry(void);
+static Elf32_Addr bind_plugin(struct dl_plugin *p, unsigned j);
+
+/* Entered from a stub with the table and the index of the function
+ * pushed, see write_stubs().  Binds it and goes there, the stack as the
+ * caller left it.
+ */
+__asm__(
+	".text\n"
+	".globl dl_lazy_entry\n"
+	".type dl_lazy_entry, @function\n"
+	"dl_lazy_entry:\n"
+	"	pushl %eax\n"
+	"	pushl %ecx\n"
+	"	pushl %edx\n"
+	"	pushl 16(%esp)\n"	/* the index */
+	"	pushl 16(%esp)\n"	/* the table */
+	"	call dl_lazy_bind\n"
+	"	addl $8, %esp\n"
+	"	movl %eax, 16(%esp)\n"	/* where ret goes */
+	"	popl %edx\n"
+	"	popl %ecx\n"
+	"	popl %eax\n"
+	"	addl $4, %esp\n"
+	"	ret\n"
+	".size dl_lazy_entry, .-dl_lazy_entry\n");
+
+/* The first call of lazily bound function j; later ones go there
+ * directly.  There is no one to report a missing function to.
+ */
+Elf32_Addr dl_lazy_bind(struct dl_lazy *lazy, unsigned j)
+{
+	unsigned long value;
+
+	if (lazy->plugin)
+		return bind_plugin(lazy->plugin, j);
+	dl_read_lock();
+	value = lookup_global_symbol(lazy->names[j]);
+	dl_read_unlock();
+	if (value == 0) {
+		ERROR("Unknown symbol: %s, called lazily\n", lazy->names[j]);
+		abort();
+	}
+	TRACE("bound %s@0x%lx\n", lazy->names[j], value);
+	/* an aligned store, callers jump to the stub or the function */
+	dl_rcu_assign(lazy->slots[j], value);
+	return value;
+}
+
+static void put32(char *p, Elf32_Addr v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/* Stub j is "jmp *slots[j]; push $j; jmp common", the slot starting out
+ * at the push; common is "push $table; jmp dl_lazy_entry".
+ */
+static void write_stub_table(struct dl_lazy *lazy)
+{
+	char *stub, *common = lazy->stubs + lazy->n * STUB_SIZE;
+	unsigned j;
+
+	for (j = 0; j < lazy->n; j++) {
+		stub = lazy->stubs + j * STUB_SIZE;
+		stub[0] = 0xff;
+		stub[1] = 0x25;
+		put32(stub + 2, (unsigned long)&lazy->slots[j]);
+		stub[6] = 0x68;
+		put32(stub + 7, j);
+		stub[11] = 0xe9;
+		put32(stub + 12, common - (stub + 16));
+		lazy->slots[j] = (unsigned long)(stub + 6);
+	}
+	common[0] = 0x68;
+	put32(common + 1, (unsigned long)lazy);
+	common[5] = 0xe9;
+	put32(common + 6, (char *)dl_lazy_entry - (common + 10));
+}
+
+/* Calls of the imports go to their stubs.  Every relocation starts over,
+ * so that nothing is bound to a module that went away.
+ */
+static void write_stubs(struct dl_load *ld)
+{
+	unsigned j;
+
+	write_stub_table(ld->lazy);
+	for (j = 0; j < ld->lazy->n; j++)
+		ld->symvals[ld->lazysyms[j]] =
+			(unsigned long)(ld->lazy->stubs + j * STUB_SIZE);
+}
+#endif /* DL_LAZY */
+
+/* The entries of mergeable section i, the strings with their NUL */
+static size_t merge_entry(struct dl_load *ld, unsigned i, size_t off)
+{
+	const Elf32_Shdr *p = ld->sechdrs + i;
+
+	if (p->sh_flags & SHF_STRINGS)
+		return strlen(ld->obj.base + p->sh_offset + off) + 1;
+	return p->sh_entsize;
+}
+
+/* DL_LAYOUT_MERGE: the strings and constants of read only SHF_MERGE
+ * sections are taken from the merge pool, see dlmerge.h, instead of
+ * being copied into the image; modules built from the same headers share
+ * them.  A section is only merged when nothing but the relocations
+ * merged_value() knows about refers to it, no global symbol is in it and
+ * it has no relocations of its own.
+ */
+static int merge_sections(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs, *p;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	const Elf32_Rel *rel;
+	struct dl_merge_entry *e;
+	struct merge_map *m;
+	unsigned char *cand;
+	unsigned i, j, k, s, num, n, total = 0;
+	size_t entsize, off, size, merged = 0, shared = 0;
+
+	cand = dl_arena_calloc(&ld->arena, ld->shnum, 1);
+	ld->merges = dl_arena_calloc(&ld->arena, ld->shnum, sizeof(*ld->merges));
+	if (cand == NULL || ld->merges == NULL)
+		return -1;
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if (ld->regions[i] != REGION_DATA || p->sh_type != SHT_PROGBITS ||
+			(p->sh_flags & (SHF_MERGE | SHF_WRITE)) != SHF_MERGE ||
+			p->sh_entsize == 0 || p->sh_size == 0)
+			continue;
+		if (p->sh_flags & SHF_STRINGS) {
+			if (p->sh_entsize != 1 ||
+				ld->obj.base[p->sh_offset + p->sh_size - 1] != '\0')
+				continue;
+		} else if (p->sh_size % p->sh_entsize) {
+			continue;
+		}
+		cand[i] = 1;
+	}
+	for (i = 1; i < ld->nsyms; i++) {
+		s = sym_shndx(sym, i, ld->xindex);
+		if (ELF_ST_BIND(sym[i].st_info) != STB_LOCAL && s < ld->shnum)
+			cand[s] = 0;
+	}
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if ((p->sh_type != SHT_REL && p->sh_type != SHT_RELA) ||
+			p->sh_info >= ld->shnum)
+			continue;
+		cand[p->sh_info] = 0;
+		if (ld->regions[p->sh_info] < 0)
+			continue;
+		entsize = p->sh_type == SHT_REL ?
+			sizeof(Elf32_Rel) : sizeof(Elf32_Rela);
+		num = p->sh_size / entsize;
+		for (j = 0; j < num; j++) {
+			rel = (const Elf32_Rel *)(p->sh_addr + j * entsize);
+			k = ELF32_R_SYM(rel->r_info);
+			if (k == 0 || k >= ld->nsyms ||
+				MERGE_RELOC_OK(ELF32_R_TYPE(rel->r_info)))
+				continue;
+			s = sym_shndx(sym, k, ld->xindex);
+			if (s < ld->shnum)
+				cand[s] = 0;
+		}
+	}
+
+	for (i = 1; i < ld->shnum; i++) {
+		for (off = 0; cand[i] && off < sechdrs[i].sh_size; total++)
+			off += merge_entry(ld, i, off);
+	}
+	if (total == 0)
+		return 0;
+	ld->merged = malloc(total * sizeof(*ld->merged));
+	if (ld->merged == NULL) {
+		ERROR("malloc failed!\n");
+		return -1;
+	}
+	for (i = 1; i < ld->shnum; i++) {
+		if (!cand[i])
+			continue;
+		p = sechdrs + i;
+		for (n = 0, off = 0; off < p->sh_size; n++)
+			off += merge_entry(ld, i, off);
+		m = dl_arena_alloc(&ld->arena, sizeof(*m) +
+				(n - 1) * sizeof(m->pieces[0]));
+		if (m == NULL)
+			return -1;
+		m->n = n;
+		for (n = 0, off = 0; off < p->sh_size; n++, off += size) {
+			size = merge_entry(ld, i, off);
+			e = dl_merge_get(ld->obj.base + p->sh_offset + off, size,
+					p->sh_addralign > 1 ? p->sh_addralign : 1);
+			if (e == NULL)
+				return -1;
+			/* discard_library() drops what was taken */
+			ld->merged[ld->nmerged++] = e;
+			if (e->refs > 1)
+				shared += size;
+			m->pieces[n].off = off;
+			m->pieces[n].addr = (unsigned long)e->data;
+		}
+		TRACE("merged %s, %u entries\n", ld->shstrtbl + p->sh_name, m->n);
+		ld->merges[i] = m;
+		ld->regions[i] = -1;
+		merged += p->sh_size;
+	}
+	INFO("%s: %lu bytes merged, %lu of them shared with other modules\n",
+		ld->name, (unsigned long)merged, (unsigned long)shared);
+	return 0;
+}
+
+#if defined(__i386__) || defined(__sparc__)
+/* The value of symbol sym plus addend if it points into a merged section:
+ * the address of the pooled copy of the piece it points into.
+ */
+static int merged_value(struct dl_load *ld, unsigned sym, Elf32_Addr addend,
+			Elf32_Addr *value)
+{
+	const Elf32_Sym *syms = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	const struct merge_map *m;
+	unsigned s, lo, hi, mid;
+	Elf32_Addr off;
+
+	if (ld->merges == NULL || sym == 0 || sym >= ld->nsyms)
+		return 0;
+	s = sym_shndx(syms, sym, ld->xindex);
+	if (s >= ld->shnum || (m = ld->merges[s]) == NULL)
+		return 0;
+	off = syms[sym].st_value + addend;
+	/* the last piece starting at or before off */
+	for (lo = 0, hi = m->n; hi - lo > 1; ) {
+		mid = (lo + hi) / 2;
+		if (m->pieces[mid].off <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	*value = m->pieces[lo].addr + (off - m->pieces[lo].off);
+	return 1;
+}
+#endif
+
+static int section_region(struct dl_load *ld, unsigned i)
+{
+	return ld->regions[i];
+}
+
+#define PIECE_BSS	NTEXTS
+
+/* The piece of memory a region goes into, -1 for the image.  Startup
+ * code always gets one of its own, so that it can be freed after the
+ * constructors ran; with DL_LAYOUT_POOL every kind of text does, from
+ * pools shared by all modules.  A large bss is mapped on its own.
+ */
+static int region_piece(struct dl_load *ld, int r)
+{
+	if (r == REGION_BSS && ld->bss_mapped)
+		return PIECE_BSS;
+	if (r == REGION_STARTUP ||
+		(region_is_text(r) && (ld->layout & DL_LAYOUT_POOL)))
+		return r;
+	return -1;
+}
+
+static size_t *piece_size(struct dl_load *ld, int piece)
+{
+	if (piece == PIECE_BSS)
+		return &ld->bss_size;
+	return piece < 0 ? &ld->image_size : &ld->text_size[piece];
+}
+
+static char *piece_base(struct dl_load *ld, int piece)
+{
+	if (piece == PIECE_BSS)
+		return ld->bss;
+	return piece < 0 ? ld->image : ld->text[piece];
+}
+
+/* The prelink cache holds a single image at a single address */
+static int prelinkable(struct dl_load *ld)
+{
+	return !(ld->layout & DL_LAYOUT_POOL) && !ld->bss_mapped &&
+		ld->text_size[TEXT_STARTUP] == 0 && ld->nmerged == 0 &&
+		ld->ndropped == 0 && ld->nfolded == 0 && ld->lazy == NULL &&
+		!ld->replaceable;
+}
+
+static unsigned dl_layout;	/* DL_LAYOUT_* */
+/* the hot functions, each with its rank + 1, see linker_profile() */
+static struct dl_exports *dl_profile;
+
+/* Mark section s as kept and queue it, see gc_sections() */
+#define GC_MARK(ld, s, stack, n) do { \
+		if ((s) > 0 && (s) < (ld)->shnum && !(ld)->keep[s]) { \
+			(ld)->keep[s] = 1; \
+			(stack)[(n)++] = (s); \
+		} \
+	} while (0)
+
+/* Section garbage collection, DL_LAYOUT_GC.  Sections defining global
+ * symbols and those holding constructors or destructors are kept, and
+ * so is everything their relocations refer to.  The rest, such as unused
+ * functions of an object built with -ffunction-sections, is not loaded.
+ */
+static int gc_sections(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs, *p;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	const char *rel, *sname;
+	unsigned *relsecs, *nextrel, *stack;
+	unsigned i, j, r, s, n = 0, num, dropped = 0;
+	size_t entsize, bytes = 0;
+
+	ld->keep = dl_arena_calloc(&ld->arena, ld->shnum, 1);
+	relsecs = dl_arena_calloc(&ld->arena, ld->shnum, sizeof(unsigned));
+	nextrel = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(unsigned));
+	stack = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(unsigned));
+	if (!ld->keep || !relsecs || !nextrel || !stack)
+		return -1;
+
+	/* the relocation sections of each section, as lists */
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if ((p->sh_type == SHT_REL || p->sh_type == SHT_RELA) &&
+			p->sh_info < ld->shnum && p->sh_link == ld->symindex) {
+			nextrel[i] = relsecs[p->sh_info];
+			relsecs[p->sh_info] = i;
+		}
+	}
+
+	for (i = 1; i < ld->nsyms; i++) {
+		if (ELF_ST_BIND(sym[i].st_info) == STB_LOCAL)
+			continue;
+		s = sym_shndx(sym, i, ld->xindex);
+		GC_MARK(ld, s, stack, n);
+	}
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		sname = ld->shstrtbl + p->sh_name;
+		if (p->sh_type == SHT_INIT_ARRAY || p->sh_type == SHT_FINI_ARRAY ||
+			p->sh_type == SHT_PREINIT_ARRAY ||
+			!strncmp(sname, ".ctors", 6) || !strncmp(sname, ".dtors", 6))
+			GC_MARK(ld, i, stack, n);
+	}
+
+	while (n > 0) {
+		s = stack[--n];
+		for (r = relsecs[s]; r; r = nextrel[r]) {
+			rel = (const char *)sechdrs[r].sh_addr;
+			entsize = sechdrs[r].sh_type == SHT_REL ?
+				sizeof(Elf32_Rel) : sizeof(Elf32_Rela);
+			num = sechdrs[r].sh_size / entsize;
+			for (j = 0; j < num; j++) {
+				i = ELF32_R_SYM(((const Elf32_Rel *)(rel + j * entsize))->r_info);
+				if (i == 0 || i >= ld->nsyms)
+					continue;
+				i = sym_shndx(sym, i, ld->xindex);
+				GC_MARK(ld, i, stack, n);
+			}
+		}
+		/* sections that go with a kept one, unwind tables and such */
+		for (i = 1; n == 0 && i < ld->shnum; i++) {
+			p = sechdrs + i;
+			if ((p->sh_flags & SHF_LINK_ORDER) && p->sh_link < ld->shnum &&
+				ld->keep[p->sh_link])
+				GC_MARK(ld, i, stack, n);
+		}
+	}
+
+	for (i = 1; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if ((p->sh_flags & SHF_ALLOC) && !ld->keep[i]) {
+			TRACE("gc: dropping %s\n", ld->shstrtbl + p->sh_name);
+			dropped++;
+			bytes += p->sh_size;
+		}
+	}
+	INFO("%s: %u unreferenced sections, %lu bytes, not loaded\n",
+		ld->name, dropped, (unsigned long)bytes);
+	return 0;
+}
+
+struct section_rank
+{
+	unsigned rank;
+	unsigned index;
+};
+
+static int compare_ranks(const void *a, const void *b)
+{
+	const struct section_rank *x = a, *y = b;
+
+	if (x->rank != y->rank)
+		return x->rank < y->rank ? -1 : 1;
+	return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* With a profile, order the sections for layout_image(): text sections
+ * holding profiled functions come first, in the order of the hottest
+ * function in each, so that the hot code is contiguous; everything else
+ * follows in object order.  Works at section granularity, the object
+ * needs -ffunction-sections for the functions to move independently.
+ */
+static int order_sections(struct dl_load *ld)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	const struct dl_exports *profile;
+	struct section_rank *ranks;
+	const char *name;
+	unsigned i, s, rank, nhot = 0;
+
+	ranks = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(*ranks));
+	ld->hot = dl_arena_calloc(&ld->arena, ld->shnum, 1);
+	if (ranks == NULL || ld->hot == NULL)
+		return -1;
+	for (i = 0; i < ld->shnum; i++) {
+		ranks[i].rank = ~0U;
+		ranks[i].index = i;
+	}
+
+	dl_read_lock();
+	profile = dl_rcu_dereference(dl_profile);
+	for (i = 1; profile && i < ld->nsyms; i++) {
+		if (ELF_ST_TYPE(sym[i].st_info) != STT_FUNC)
+			continue;
+		s = sym_shndx(sym, i, ld->xindex);
+		if (s >= ld->shnum || !region_is_text(section_region(ld, s)))
+			continue;
+		name = ld->strtab + sym[i].st_name;
+		rank = exports_lookup(profile, name, dl_gnu_hash(name));
+		if (rank == 0 || rank - 1 >= ranks[s].rank)
+			continue;
+		if (!ld->hot[s])
+			nhot++;
+		ld->hot[s] = 1;
+		ranks[s].rank = rank - 1;
+	}
+	dl_read_unlock();
+	if (nhot == 0)
+		return 0;
+
+	qsort(ranks, ld->shnum, sizeof(*ranks), compare_ranks);
+	ld->order = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(unsigned));
+	if (ld->order == NULL)
+		return -1;
+	for (i = 0; i < ld->shnum; i++)
+		ld->order[i] = ranks[i].index;
+	TRACE("%s: %u hot text sections first\n", ld->name, nhot);
+	return 0;
+}
+
+struct func_place
+{
+	Elf32_Addr addr;
+	unsigned sym;
+};
+
+static int compare_places(const void *a, const void *b)
+{
+	const struct func_place *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : (x->addr > y->addr);
+}
+
+/* Where the functions of an ordered module landed, by address */
+static void report_layout(struct dl_load *ld)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	struct func_place *places;
+	unsigned i, s, n = 0;
+
+	places = dl_arena_alloc(&ld->arena, ld->nsyms * sizeof(*places));
+	if (places == NULL)
+		return;
+	for (i = 1; i < ld->nsyms; i++) {
+		if (ELF_ST_TYPE(sym[i].st_info) != STT_FUNC)
+			continue;
+		s = sym_shndx(sym, i, ld->xindex);
+		if (s >= ld->shnum || !region_is_text(section_region(ld, s)))
+			continue;
+		places[n].addr = sym[i].st_value + ld->sechdrs[s].sh_addr;
+		places[n++].sym = i;
+	}
+	qsort(places, n, sizeof(*places), compare_places);
+	INFO("%s: text layout\n", ld->name);
+	for (i = 0; i < n; i++) {
+		s = sym_shndx(sym, places[i].sym, ld->xindex);
+		INFO("  %08lx %6u %-7s %s %s\n", (unsigned long)places[i].addr,
+			sym[places[i].sym].st_size,
+			region_names[section_region(ld, s)],
+			ld->hot[s] ? "hot " : "cold",
+			ld->strtab + sym[places[i].sym].st_name);
+	}
+}
+
+/* COMMON symbols go at the end of the bss, st_value is their alignment */
+static size_t layout_commons(struct dl_load *ld, size_t off, size_t *used)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	size_t align;
+	unsigned i;
+
+	for (i = 1; i < ld->nsyms; i++) {
+		if (sym_shndx(sym, i, ld->xindex) != SHN_COMMON)
+			continue;
+		align = sym[i].st_value > 1 ? sym[i].st_value : 1;
+		off = (off + align - 1) & ~(align - 1);
+		ld->commons[i] = off;
+		off += sym[i].st_size;
+		*used += sym[i].st_size;
+		if (align > ld->image_align)
+			ld->image_align = align;
+		TRACE("common:%s %uB bytes @ +0x%lx\n", ld->strtab + sym[i].st_name,
+			sym[i].st_size, (unsigned long)ld->commons[i]);
+	}
+	return off;
+}
+
+/* Place every section at its sh_addralign within its region.  With
+ * DL_LAYOUT_CACHELINE writable sections get cache lines of their own, so
+ * that they share none with other sections or modules; DL_LAYOUT_PAGE
+ * starts the data on a page of its own.  Regions in pieces of text of
+ * their own, see region_piece(), are laid out separately, offsets are
+ * from the start of the piece.  Returns the image size.
+ */
+static size_t layout_image(struct dl_load *ld)
+{
+	Elf32_Shdr *p;
+	size_t off = 0, used = 0, total = 0, align, size;
+	unsigned layout = ld->layout;
+	unsigned i, k;
+	int r, first, piece, cur = region_piece(ld, 0);
+
+	ld->image_align = 1;
+	memset(ld->text_size, 0, sizeof(ld->text_size));
+	for (r = 0; r < NREGIONS; r++) {
+		piece = region_piece(ld, r);
+		if (piece != cur) {
+			*piece_size(ld, cur) = off;
+			total += off;
+			off = 0;
+			cur = piece;
+		}
+		first = 1;
+		for (k = 0; k < ld->shnum; k++) {
+			i = ld->order ? ld->order[k] : k;
+			p = ld->sechdrs + i;
+			if (section_region(ld, i) != r)
+				continue;
+			align = p->sh_addralign > 1 ? p->sh_addralign : 1;
+			size = p->sh_size;
+			if ((layout & DL_LAYOUT_CACHELINE) && (p->sh_flags & SHF_WRITE)) {
+				if (align < DL_CACHELINE)
+					align = DL_CACHELINE;
+				size = (size + DL_CACHELINE - 1) & ~(size_t)(DL_CACHELINE - 1);
+			}
+			if ((layout & DL_LAYOUT_PAGE) && first && !region_is_text(r) &&
+				off != 0 && align < DL_PAGE_SIZE)
+				align = DL_PAGE_SIZE;
+			first = 0;
+			off = (off + align - 1) & ~(align - 1);
+			ld->offsets[i] = off;
+			off += size;
+			used += p->sh_size;
+			if (align > ld->image_align)
+				ld->image_align = align;
+			TRACE("section:%s %uB bytes @ +0x%lx\n",
+				ld->shstrtbl + p->sh_name, p->sh_size,
+				(unsigned long)ld->offsets[i]);
+		}
+		if (r == REGION_BSS && ld->commons)
+			off = layout_commons(ld, off, &used);
+#ifdef DL_LAZY
+		/* the stubs after the text, their slots after the data */
+		if (ld->lazy && r == REGION_TEXT) {
+			off = (off + STUB_SIZE - 1) & ~(size_t)(STUB_SIZE - 1);
+			ld->stub_off = off;
+			off += (ld->lazy->n + 1) * STUB_SIZE;
+			used += (ld->lazy->n + 1) * STUB_SIZE;
+			if (STUB_SIZE > ld->image_align)
+				ld->image_align = STUB_SIZE;
+		}
+		if (ld->lazy && r == REGION_DATA) {
+			off = (off + sizeof(Elf32_Addr) - 1) &
+				~(size_t)(sizeof(Elf32_Addr) - 1);
+			ld->slot_off = off;
+			off += ld->lazy->n * sizeof(Elf32_Addr);
+			used += ld->lazy->n * sizeof(Elf32_Addr);
+		}
+#endif
+	}
+	*piece_size(ld, cur) = off;
+	ld->image_pad = total + off - used;
+	return ld->image_size;
+}
+
+/* Point the sections, and COMMON symbols, at where they are in the
+ * image or their piece
+ */
+static void place_sections(struct dl_load *ld)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	char *bss = piece_base(ld, region_piece(ld, REGION_BSS));
+	struct fold *f;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < ld->shnum; i++) {
+		r = section_region(ld, i);
+		if (r < 0)
+			continue;
+		ld->sechdrs[i].sh_addr = (unsigned long)
+			(piece_base(ld, region_piece(ld, r)) + ld->offsets[i]);
+	}
+	for (i = 1; ld->commons && i < ld->nsyms; i++) {
+		if (sym_shndx(sym, i, ld->xindex) == SHN_COMMON)
+			ld->symvals[i] = (unsigned long)(bss + ld->commons[i]);
+	}
+	for (i = 0; i < ld->nfolds; i++) {
+		f = &ld->folds[i];
+		if (f->alias)
+			ld->sechdrs[f->sec].sh_addr = ld->sechdrs[f->alias].sh_addr;
+		else if (f->addr)
+			ld->sechdrs[f->sec].sh_addr = f->addr;
+	}
+#ifdef DL_LAZY
+	if (ld->lazy) {
+		ld->lazy->stubs = piece_base(ld, region_piece(ld, REGION_TEXT)) +
+			ld->stub_off;
+		ld->lazy->slots = (Elf32_Addr *)(piece_base(ld,
+			region_piece(ld, REGION_DATA)) + ld->slot_off);
+	}
+#endif
+}
+
+/* Copy the sections in from the object */
+static void copy_sections(struct dl_load *ld)
+{
+	Elf32_Shdr *p;
+	const char *sname;
+	int i, r;
+
+	TRACE("loading needed sections...\n");
+	place_sections(ld);
+	for (i = 0; i < ld->shnum; i++) {
+		p = ld->sechdrs + i;
+		r = section_region(ld, i);
+		if (r < 0)
+			continue;
+		sname = ld->shstrtbl + p->sh_name;
+		if (r == REGION_BSS) {
+			/* nothing in the file, the image is already zeroed */
+			TRACE("allocating section: %s\n", sname);
+		} else {
+			TRACE("loading %s section: %s\n", region_names[r], sname);
+			memcpy((char *)p->sh_addr, ld->obj.base + p->sh_offset,
+				p->sh_size);
+		}
+	}
+}
+
+/* Loads prepared from now on are laid out by flags, each reads them once.
+ * Called with the loader lock held.
+ */
+unsigned linker_layout(unsigned flags)
+{
+	unsigned old = dl_layout;
+
+#ifdef DL_POOLS
+	int t, huge = (flags & DL_LAYOUT_HUGEPAGE) != 0;
+
+	for (t = 0; t < NTEXTS; t++)
+		dl_pool_set_huge(&textpools[t], huge);
+	dl_pool_set_huge(&datapool, huge);
+#else
+	flags &= ~(DL_LAYOUT_POOL | DL_LAYOUT_HUGEPAGE);
+#endif
+	dl_rcu_assign(dl_layout, flags);
+	return old;
+}
+
+/* Read the ordering profile for the text of modules loaded from now
+ * on: the names of the hot functions, hottest first, one per line, with
+ * '#' starting a comment.  NULL drops the profile.  Called with the
+ * loader lock held.
+ */
+int linker_profile(const char *file)
+{
+	struct dl_exports *profile = NULL, *old;
+	struct dl_export_def *defs = NULL;
+	char buf[512], *name, *end;
+	unsigned n = 0, max = 0;
+	FILE *f;
+	int ret = -1;
+
+	if (file) {
+		f = fopen(file, "r");
+		if (f == NULL) {
+			ERROR("cannot open profile %s\n", file);
+			return -1;
+		}
+		while (fgets(buf, sizeof(buf), f)) {
+			for (name = buf; isspace((unsigned char)*name); name++)
+				;
+			for (end = name; *end && *end != '#' &&
+				!isspace((unsigned char)*end); end++)
+				;
+			if (end == name)
+				continue;
+			*end = '\0';
+			if (n == max) {
+				struct dl_export_def *d;
+
+				max = max ? 2 * max : 64;
+				d = realloc(defs, max * sizeof(*defs));
+				if (d == NULL)
+					goto out;
+				defs = d;
+			}
+			defs[n].name = strdup(name);
+			if (defs[n].name == NULL)
+				goto out;
+			defs[n].hash = dl_gnu_hash(name);
+			defs[n].value = n + 1;
+			n++;
+		}
+		profile = exports_build(defs, n);
+		if (profile == NULL)
+			goto out;
+		TRACE("profile %s: %u hot functions\n", file, n);
+	}
+	old = dl_profile;
+	dl_rcu_assign(dl_profile, profile);
+	if (old)
+		dl_defer_free(old);
+	ret = 0;
+
+out:
+	if (file)
+		fclose(f);
+	while (n > 0)
+		free((char *)defs[--n].name);
+	free(defs);
+	return ret;
+}
+
+/* Where the global symbols of the objects in a directory are defined,
+ * see linker_autoload()
+ */
+struct dl_providers
+{
+	struct dl_exports *syms;	/* offset + 1 of the path of each */
+	char *paths;
+};
+
+static struct dl_providers *dl_providers;
+
+static void free_providers(void *arg)
+{
+	struct dl_providers *prov = arg;
+
+	free(prov->syms);
+	free(prov->paths);
+	free(prov);
+}
+
+/* Add the global definitions of the object in path to defs[], the names
+ * in arena.  Their value is value, or with value 0 their symbol type + 1.
+ */
+static int scan_exports(const char *path, unsigned long value,
+			struct dl_export_def **defs, unsigned *n, unsigned *max,
+			struct dl_arena *arena)
+{
+	struct elf_object obj;
+	const Elf32_Ehdr *hdr;
+	Elf32_Shdr *sechdrs;
+	const Elf32_Sym *sym;
+	const char *strtab;
+	struct dl_export_def *d;
+	unsigned i, shnum, nsyms;
+	char *name;
+	int fd, ret = -1;
+
+	fd = open_library(path);
+	if (fd < 0)
+		return -1;
+	i = elf_map(fd, &obj, arena);
+	close(fd);
+	if ((int)i < 0)
+		return -1;
+	hdr = (const Elf32_Ehdr *)obj.base;
+	if (verify_elf_object((void *)hdr, path) < 0 ||
+		hdr->e_shentsize != sizeof(Elf32_Shdr) || hdr->e_shoff > obj.size ||
+		obj.size - hdr->e_shoff < sizeof(Elf32_Shdr))
+		goto out;
+	sechdrs = (Elf32_Shdr *)(obj.base + hdr->e_shoff);
+	shnum = hdr->e_shnum ? hdr->e_shnum : sechdrs->sh_size;
+	if (shnum > (obj.size - hdr->e_shoff) / sizeof(Elf32_Shdr))
+		goto out;
+	for (i = 1; i < shnum; i++) {
+		if (sechdrs[i].sh_type == SHT_SYMTAB && sechdrs[i].sh_link < shnum &&
+			elf_section_ok(&obj, sechdrs + i) &&
+			elf_section_ok(&obj, sechdrs + sechdrs[i].sh_link))
+			break;
+	}
+	if (i == shnum)
+		goto out;
+	sym = (const Elf32_Sym *)(obj.base + sechdrs[i].sh_offset);
+	nsyms = sechdrs[i].sh_size / sizeof(Elf32_Sym);
+	strtab = obj.base + sechdrs[sechdrs[i].sh_link].sh_offset;
+	for (i = 1; i < nsyms; i++) {
+		if (ELF_ST_BIND(sym[i].st_info) != STB_GLOBAL ||
+			ELF_ST_TYPE(sym[i].st_info) == STT_SECTION ||
+			sym[i].st_shndx == SHN_UNDEF)
+			continue;
+		if (*n == *max) {
+			*max = *max ? 2 * *max : 256;
+			d = realloc(*defs, *max * sizeof(*d));
+			if (d == NULL)
+				goto out;
+			*defs = d;
+		}
+		name = dl_arena_alloc(arena, strlen(strtab + sym[i].st_name) + 1);
+		if (name == NULL)
+			goto out;
+		strcpy(name, strtab + sym[i].st_name);
+		(*defs)[*n].name = name;
+		(*defs)[*n].hash = dl_gnu_hash(name);
+		(*defs)[*n].value = value ? value :
+			(unsigned long)ELF_ST_TYPE(sym[i].st_info) + 1;
+		(*n)++;
+	}
+	ret = 0;
+
+out:
+	elf_unmap(&obj);
+	return ret;
+}
+
+/* Index the global symbols of the objects (*.o) in dir; a module missing
+ * one of them then loads the object defining it, see autoload_deps(), as
+ * does dlsym() not finding it.  NULL drops the index.
+ */
+int linker_autoload(const char *dir)
+{
+	struct dl_providers *prov = NULL, *old;
+	struct dl_export_def *defs = NULL;
+	struct dl_arena arena;
+	struct dirent *e;
+	char file[512], path[SOINFO_NAME_LEN], *paths = NULL, *p;
+	size_t len, size = 0, max = 0;
+	unsigned n = 0, maxdefs = 0, nobjs = 0, nold;
+	DIR *d;
+	int ret = -1;
+
+	dl_arena_init(&arena);
+	if (dir) {
+		d = opendir(dir);
+		if (d == NULL) {
+			ERROR("cannot open module directory %s\n", dir);
+			return -1;
+		}
+		while ((e = readdir(d))) {
+			len = strlen(e->d_name);
+			if (len < 3 || strcmp(e->d_name + len - 2, ".o"))
+				continue;
+			if (snprintf(file, sizeof(file), "%s/%s", dir, e->d_name) >=
+					(int)sizeof(file) || canon_name(file, path) < 0) {
+				ERROR("library name %s/%s too long\n", dir, e->d_name);
+				continue;
+			}
+			len = strlen(path) + 1;
+			if (size + len > max) {
+				max = 2 * (size + len);
+				p = realloc(paths, max);
+				if (p == NULL)
+					break;
+				paths = p;
+			}
+			nold = n;
+			if (scan_exports(path, size + 1, &defs, &n, &maxdefs,
+					&arena) < 0) {
+				TRACE("%s: no symbols to index\n", path);
+				n = nold;
+				continue;
+			}
+			memcpy(paths + size, path, len);
+			size += len;
+			nobjs++;
+		}
+		closedir(d);
+		if (e)
+			goto out;
+		prov = calloc(1, sizeof(*prov));
+		if (prov == NULL)
+			goto out;
+		prov->syms = exports_build(defs, n);
+		if (prov->syms == NULL)
+			goto out;
+		prov->paths = paths;
+		paths = NULL;
+		INFO("%s: %u symbols in %u objects\n", dir, n, nobjs);
+	}
+	old = dl_providers;
+	dl_rcu_assign(dl_providers, prov);
+	if (old)
+		dl_defer(free_providers, old);
+	prov = NULL;
+	ret = 0;
+
+out:
+	if (prov)
+		free_providers(prov);
+	free(paths);
+	free(defs);
+	dl_arena_free(&arena);
+	return ret;
+}
+
+/* The object defining name, if indexed.  Readers only, the path goes
+ * with the index.
+ */
+static const char *provider_of(const char *name)
+{
+	struct dl_providers *prov = dl_rcu_dereference(dl_providers);
+	unsigned long off;
+
+	if (prov == NULL)
+		return NULL;
+	off = exports_lookup(prov->syms, name, dl_gnu_hash(name));
+	return off ? prov->paths + off - 1 : NULL;
+}
+
+#ifdef DL_LAZY
+/* A module opened with RTLD_DEFER: what it defines is read from its
+ * symbol table, and dlsym() hands out stubs for its functions that load
+ * it on their first call, see open_plugin().
+ */
+struct dl_plugin
+{
+	char name[SOINFO_NAME_LEN];
+	struct dl_plugin *next;
+	unsigned refcount;
+	soinfo *si;		/* once loaded */
+	struct dl_exports *syms;	/* stub index + 1, or PLUGIN_DATA */
+	struct dl_lazy *lazy;
+};
+
+#define PLUGIN_DATA	(~0UL)	/* not a function, dlsym() loads the module */
+
+static struct dl_plugin *plugins;
+
+/* With the pools the stubs are sealed like module text */
+static char *alloc_stubs(size_t size)
+{
+	char *stubs;
+
+#ifdef DL_POOLS
+	stubs = dl_pool_alloc(&textpools[TEXT_COLD], size, STUB_SIZE);
+#else
+	if (posix_memalign((void **)&stubs, STUB_SIZE, size))
+		stubs = NULL;
+#endif
+	return stubs;
+}
+
+/* A table from alloc_stubs(), and the tables of earlier versions */
+static void free_stubs(struct dl_lazy *lazy)
+{
+	struct dl_lazy *next;
+
+	for (; lazy; lazy = next) {
+		next = lazy->next;
+		if (lazy->stubs) {
+#ifdef DL_POOLS
+			dl_pool_free(&textpools[TEXT_COLD], lazy->stubs,
+				(lazy->n + 1) * STUB_SIZE);
+#else
+			free(lazy->stubs);
+#endif
+		}
+		free(lazy->slots);
+		free(lazy);
+	}
+}
+
+static void free_plugin(void *arg)
+{
+	struct dl_plugin *p = arg;
+
+	free_stubs(p->lazy);
+	free(p->syms);
+	free(p);
+}
+
+/* The stubs of the functions of p, named after its exports */
+static int plugin_stubs(struct dl_plugin *p, unsigned nfuncs)
+{
+	struct dl_exports *ex = p->syms;
+	struct dl_lazy *lazy;
+	size_t size = (nfuncs + 1) * STUB_SIZE;
+	unsigned i, j = 0;
+
+	lazy = calloc(1, sizeof(*lazy) + (nfuncs - 1) * sizeof(char *));
+	if (lazy == NULL)
+		return -1;
+	p->lazy = lazy;
+	lazy->n = nfuncs;
+	lazy->plugin = p;
+	lazy->slots = malloc(nfuncs * sizeof(Elf32_Addr));
+	lazy->stubs = alloc_stubs(size);
+	if (lazy->slots == NULL || lazy->stubs == NULL)
+		return -1;
+	for (i = 0; i < ex->nsyms; i++) {
+		if (ex->values[i] != STT_FUNC + 1) {
+			ex->values[i] = PLUGIN_DATA;
+			continue;
+		}
+		lazy->names[j] = dl_export_name(ex, i);
+		ex->values[i] = ++j;
+	}
+	write_stub_table(lazy);
+#ifdef DL_POOLS
+	if (dl_pool_seal(&textpools[TEXT_COLD], lazy->stubs, size) < 0)
+		return -1;
+#endif
+	return 0;
+}
+
+/* Open name with RTLD_DEFER: only its symbol table is read, the module
+ * is loaded once one of its functions is called through what dlsym()
+ * returned, or dlsym() is asked for its data.  Modules without functions
+ * and modules loaded already are loaded as usual.  Returns the handle,
+ * its reference taken.  Called with the loader lock held, which is
+ * dropped while the object is read.
+ */
+void *open_plugin(const char *name)
+{
+	struct dl_export_def *defs = NULL;
+	struct dl_plugin *p, *q;
+	struct dl_arena arena;
+	soinfo *si;
+	char canon[SOINFO_NAME_LEN];
+	unsigned i, n = 0, max = 0, nfuncs = 0;
+	int ret;
+
+	if (canon_name(name, canon) < 0) {
+		ERROR("library name %s too long\n", name);
+		return NULL;
+	}
+	name = canon;
+
+	for (p = plugins; p; p = p->next) {
+		if (!strcmp(p->name, name)) {
+			p->refcount++;
+			return p;
+		}
+	}
+	si = find_loaded_library(name);
+	if (si)
+		goto load;
+
+	dl_arena_init(&arena);
+	dl_write_unlock();
+	ret = scan_exports(name, 0, &defs, &n, &max, &arena);
+	dl_write_lock();
+	for (i = 0; i < n; i++)
+		nfuncs += defs[i].value == STT_FUNC + 1;
+	p = ret < 0 || nfuncs == 0 ? NULL : calloc(1, sizeof(*p));
+	if (p) {
+		strcpy(p->name, name);
+		p->refcount = 1;
+		p->syms = exports_build(defs, n);
+		if (p->syms == NULL || plugin_stubs(p, nfuncs) < 0) {
+			ERROR("cannot defer %s\n", name);
+			free_plugin(p);
+			p = NULL;
+		}
+	}
+	free(defs);
+	dl_arena_free(&arena);
+	if (p == NULL)
+		goto load;
+	/* opened meanwhile */
+	for (q = plugins; q && strcmp(q->name, name); q = q->next)
+		;
+	if (q) {
+		free_plugin(p);
+		q->refcount++;
+		return q;
+	}
+	INFO("%s: %u functions deferred\n", name, nfuncs);
+	p->next = plugins;
+	dl_rcu_assign(plugins, p);
+	return p;
+
+load:
+	si = find_library(name, RTLD_NOW);
+	if (si)
+		si->refcount++;
+	return si;
+}
+
+/* The module opened with RTLD_DEFER that handle is, if it is one */
+struct dl_plugin *find_plugin(const void *handle)
+{
+	struct dl_plugin *p;
+
+	for (p = dl_rcu_dereference(plugins); p; p = dl_rcu_dereference(p->next)) {
+		if (p == handle)
+			return p;
+	}
+	return NULL;
+}
+
+/* Load p and point the stubs at its functions.  Called with the loader
+ * lock held, which is dropped while loading.
+ */
+static int load_plugin(struct dl_plugin *p)
+{
+	struct dl_lazy *lazy = p->lazy;
+	unsigned long value;
+	soinfo *si;
+	unsigned j;
+
+	if (p->si)
+		return 0;
+	TRACE("loading deferred %s\n", p->name);
+	si = find_library(p->name, RTLD_NOW);
+	if (si == NULL)
+		return -1;
+	/* unless someone else did meanwhile */
+	if (p->si == NULL) {
+		si->refcount++;
+		for (j = 0; j < lazy->n; j++) {
+			value = lookup_in_library(si, lazy->names[j]);
+			if (value)
+				dl_rcu_assign(lazy->slots[j], value);
+		}
+		dl_rcu_assign(p->si, si);
+	}
+	return 0;
+}
+
+/* The first call of function j of p through its stub */
+static Elf32_Addr bind_plugin(struct dl_plugin *p, unsigned j)
+{
+	unsigned long value = 0;
+
+	dl_write_lock();
+	if (load_plugin(p) == 0)
+		value = lookup_in_library(p->si, p->lazy->names[j]);
+	linker_unlock();
+	if (value == 0) {
+		ERROR("cannot load %s for %s, called\n", p->name,
+			p->lazy->names[j]);
+		abort();
+	}
+	TRACE("bound %s@0x%lx\n", p->lazy->names[j], value);
+	return value;
+}
+
+/* dlsym() of p: the stub of a function until p is loaded, data loads it.
+ * Called with the loader lock held.
+ */
+unsigned long lookup_in_plugin(struct dl_plugin *p, const char *name)
+{
+	unsigned long value;
+
+	if (p->si == NULL) {
+		value = exports_lookup(p->syms, name, dl_gnu_hash(name));
+		if (value == 0)
+			return 0;
+		if (value != PLUGIN_DATA)
+			return (unsigned long)(p->lazy->stubs +
+				(value - 1) * STUB_SIZE);
+		if (load_plugin(p) < 0)
+			return 0;
+	}
+	return lookup_in_library(p->si, name);
+}
+
+/* Drop a reference to p, and p with the last one.  Its stubs go once
+ * nobody can be in them.  Called with the loader lock held.
+ */
+unsigned close_plugin(struct dl_plugin *p)
+{
+	struct dl_plugin **pp;
+
+	if (--p->refcount)
+		return p->refcount;
+	for (pp = &plugins; *pp != p; pp = &(*pp)->next)
+		;
+	dl_rcu_assign(*pp, p->next);
+	if (p->si)
+		unload_library(p->si);
+	dl_defer(free_plugin, p);
+	return 0;
+}
+
+/* RTLD_REPLACEABLE: the exported functions of the module are published
+ * as trampolines, so that a new version can take over the calls of
+ * whoever was bound to them, see replace_library().
+ */
+static int make_trampolines(struct dl_load *ld, soinfo *si)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	struct dl_exports *ex = si->exports;
+	struct dl_lazy *t;
+	const char *name;
+	size_t size = 0;
+	unsigned j, n = ld->nfuncs;
+	int i;
+	char *q;
+
+	if (n == 0)
+		return 0;
+	for (j = 0; j < n; j++)
+		size += strlen(ld->strtab + sym[ld->funcs[j]].st_name) + 1;
+	t = calloc(1, sizeof(*t) + (n - 1) * sizeof(char *) + size);
+	if (t == NULL)
+		return -1;
+	si->tramps = t;
+	t->n = n;
+	t->slots = malloc(n * sizeof(Elf32_Addr));
+	t->stubs = alloc_stubs((n + 1) * STUB_SIZE);
+	if (t->slots == NULL || t->stubs == NULL)
+		return -1;
+	write_stub_table(t);
+	q = (char *)&t->names[n];
+	for (j = 0; j < n; j++) {
+		name = strcpy(q, ld->strtab + sym[ld->funcs[j]].st_name);
+		q += strlen(q) + 1;
+		t->names[j] = name;
+		i = exports_find(ex, name, dl_gnu_hash(name));
+		t->slots[j] = ex->values[i];
+		ex->values[i] = (unsigned long)(t->stubs + j * STUB_SIZE);
+	}
+#ifdef DL_POOLS
+	if (dl_pool_seal(&textpools[TEXT_COLD], t->stubs,
+			(n + 1) * STUB_SIZE) < 0)
+		return -1;
+#endif
+	TRACE("%s: %u trampolines\n", si->name, n);
+	return 0;
+}
+
+/* Where the trampoline of name in si goes, or 0 */
+static Elf32_Addr tramp_target(soinfo *si, const char *name)
+{
+	struct dl_lazy *t = si->tramps;
+	unsigned j;
+
+	for (j = 0; t && j < t->n; j++) {
+		if (!strcmp(t->names[j], name))
+			return t->slots[j];
+	}
+	return 0;
+}
+
+/* The RTLD_REPLACEABLE module name is bound to other than through one of
+ * its trampolines, if any: its data, say.  Calls through trampolines go
+ * to the new version when it is replaced, the rest would stay in the old
+ * one.  Readers only.
+ */
+static soinfo *bound_replaceable(const char *name)
+{
+	const struct symhash_entry *e;
+	const struct dl_lazy *t;
+	uint32_t hash = dl_gnu_hash(name);
+	soinfo *si;
+
+	if ((sysmph && sysmph_lookup(sysmph, name, hash)) ||
+		(sysmap.hdr && sysmap_lookup(&sysmap, name, hash)))
+		return NULL;
+	e = symhash_lookup(&globalsyms, name, hash);
+	if (e == NULL || (si = (soinfo *)e->owner) == NULL ||
+		si->tramps == NULL)
+		return NULL;
+	for (t = si->tramps; t; t = t->next) {
+		if (e->value >= (unsigned long)t->stubs &&
+			e->value < (unsigned long)(t->stubs + t->n * STUB_SIZE))
+			return NULL;
+	}
+	return si;
+}
+
+/* Hold the RTLD_REPLACEABLE modules ld is bound to other than through
+ * trampolines, like owners, so that replace_library() refuses them while
+ * si is around.  Called with the loader lock held.
+ */
+static int hold_bound(struct dl_load *ld, soinfo *si)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	unsigned j, max = ld->ndropped + ld->nfolded + ld->nneeds;
+	soinfo **owners, *held;
+	const char *name;
+
+	for (j = 0; j < ld->nimports; j++) {
+		name = ld->strtab + sym[ld->imports[j]].st_name;
+		held = bound_replaceable(name);
+		if (held == NULL || held == si)
+			continue;
+		owners = realloc(si->owners, ++max * sizeof(*owners));
+		if (owners == NULL)
+			return -1;
+		si->owners = owners;
+		hold_owner(si, held);
+	}
+	return 0;
+}
+
+/* The module holding si, see unload_library(), if any */
+static soinfo *holder_of(soinfo *si)
+{
+	soinfo *h;
+	unsigned j;
+
+	for (h = solist; h; h = h->next) {
+		for (j = 0; j < h->nowners; j++) {
+			if (h->owners[j] == si)
+				return h;
+		}
+	}
+	return NULL;
+}
+
+/* Load name as the new version of old: the trampolines of old, and of
+ * the versions before it, are pointed at the functions of the new one,
+ * which takes over the references to old.  old is found by name until
+ * then; afterwards nothing finds or binds to it, and it goes once every
+ * thread that may be running in it was quiescent, see reclaim_retired().
+ * Its data is not carried over.  Called with the loader lock held, which
+ * is dropped while the new version is loaded.
+ */
+soinfo *replace_library(soinfo *old, const char *name)
+{
+	struct dl_lazy *t;
+	Elf32_Addr value;
+	soinfo *si, *held;
+	unsigned j;
+
+	if (old->tramps == NULL) {
+		ERROR("%s was not opened with RTLD_REPLACEABLE\n", old->name);
+		return NULL;
+	}
+	if (old->flags & FLAG_REPLACING) {
+		ERROR("%s is being replaced already\n", old->name);
+		return NULL;
+	}
+	/* by COMDAT groups, folded functions or data others use */
+	if ((si = holder_of(old)) != NULL) {
+		ERROR("%s is held by %s\n", old->name, si->name);
+		return NULL;
+	}
+
+	/* the new version may have the same name, it goes in the index after
+	 * old until it is linked; our references keep both meanwhile
+	 */
+	old->flags |= FLAG_REPLACING;
+	old->refcount++;
+	si = find_library(name, RTLD_NOW | RTLD_REPLACEABLE | DL_REPLACING);
+	if (si == NULL)
+		goto fail;
+	/* its constructors run before calls go there */
+	si->refcount++;
+	run_pending();
+	if (old->refcount == 1) {
+		ERROR("%s was closed meanwhile\n", old->name);
+		unload_library(si);
+		goto fail;
+	}
+	if ((held = holder_of(old)) != NULL) {
+		ERROR("%s is held by %s\n", old->name, held->name);
+		unload_library(si);
+		goto fail;
+	}
+	for (t = old->tramps; t; t = t->next) {
+		for (j = 0; j < t->n; j++) {
+			if (tramp_target(si, t->names[j]) == 0) {
+				ERROR("%s does not define %s\n", name, t->names[j]);
+				unload_library(si);
+				goto fail;
+			}
+		}
+	}
+
+	/* the new version is found by name from now on */
+	symhash_remove(&modules, old->name, dl_gnu_hash(old->name), old);
+	/* an aligned store, callers go to either version */
+	for (t = old->tramps; t; t = t->next) {
+		for (j = 0; j < t->n; j++) {
+			value = tramp_target(si, t->names[j]);
+			dl_rcu_assign(t->slots[j], value);
+		}
+	}
+	INFO("%s replaces %s\n", name, old->name);
+	for (t = si->tramps; t->next; t = t->next)
+		;
+	t->next = old->tramps;
+	old->tramps = NULL;
+	/* ours are among both, the one left on old is the retire list's */
+	si->refcount += old->refcount - 2;
+	old->flags &= ~FLAG_REPLACING;
+	old->refcount = 1;
+	withdraw_library(old);
+	old->retired = dl_grace_begin();
+	old->retired_next = retired;
+	dl_rcu_assign(retired, old);
+	return si;
+
+fail:
+	old->flags &= ~FLAG_REPLACING;
+	unload_library(old);
+	return NULL;
+}
+#endif /* DL_LAZY */
+
+/* Define the object's own symbols and, unless it already has one from
+ * the prelink cache, build its export table.
+ */
+static int define_library(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs;
+	const Elf32_Sym *sym = (const Elf32_Sym *)sechdrs[ld->symindex].sh_addr;
+	unsigned *exports, nexports, i;
+
+	exports = dl_arena_alloc(&ld->arena, ld->nsyms * sizeof(unsigned));
+	if (exports == NULL)
+		return -1;
+	TRACE("defining symbols...\n");
+	if (define_symbols(sechdrs, ld->shnum, ld->symindex, ld->xindex,
+			ld->strtab, ld->symvals,
+			exports, &nexports, ld->imports, &ld->nimports) < 0)
+		return -1;
+	if (ld->exports == NULL)
+		ld->exports = build_exports(sym, ld->strtab, ld->symvals,
+			exports, nexports, &ld->arena);
+	if (ld->replaceable) {
+		ld->funcs = exports;
+		ld->nfuncs = 0;
+		for (i = 0; i < nexports; i++) {
+			if (ELF_ST_TYPE(sym[exports[i]].st_info) == STT_FUNC)
+				ld->funcs[ld->nfuncs++] = exports[i];
+		}
+	}
+	return ld->exports ? 0 : -1;
+}
+
+#ifdef DL_PRELINK
+static uint64_t sysid;		/* the system symbols, see linker_prelink() */
+
+/* Take the image from the prelink cache, if there is one for this object
+ * that can be placed where it was relocated for and whose imports still
+ * resolve to the same values.
+ */
+static int load_prelinked(struct dl_load *ld, size_t size)
+{
+	struct prelink pl;
+	struct dl_export_def *defs;
+	const struct prelink_sym *s;
+	char *want, *image = NULL;
+	unsigned i, n;
+
+	ld->key = prelink_key(ld->obj.base, ld->obj.size, sysid);
+	ld->key = prelink_key(&ld->layout, sizeof(ld->layout), ld->key);
+	if (ld->order)
+		ld->key = prelink_key(ld->order, ld->shnum * sizeof(unsigned), ld->key);
+	if (prelink_open(ld->key, &pl) < 0)
+		return -1;
+	if (pl.hdr->size != size)
+		goto fail;
+	want = (char *)(unsigned long)pl.hdr->base;
+	image = mmap(want, size ? size : 1, PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (image == MAP_FAILED) {
+		image = NULL;
+		goto fail;
+	}
+	if (image != want) {
+		TRACE("%s: prelinked address %p is taken\n", ld->name, want);
+		goto fail;
+	}
+
+	dl_read_lock();
+	ld->unloads = dl_rcu_dereference(dl_unloads);
+	for (i = 0, s = pl.imports; i < pl.hdr->nimports; i++, s++) {
+		if (lookup_global_symbol(pl.strings + s->name) != s->value)
+			break;
+#ifdef DL_LAZY
+		/* not recorded in the cache, see hold_bound() */
+		if (bound_replaceable(pl.strings + s->name))
+			break;
+#endif
+	}
+	dl_read_unlock();
+	if (i < pl.hdr->nimports) {
+		TRACE("%s: %s has moved or is replaceable\n", ld->name,
+			pl.strings + s->name);
+		goto fail;
+	}
+
+	n = pl.hdr->nexports;
+	defs = dl_arena_alloc(&ld->arena, n * sizeof(*defs));
+	if (defs == NULL)
+		goto fail;
+	for (i = 0, s = pl.exports; i < n; i++, s++) {
+		defs[i].name = pl.strings + s->name;
+		defs[i].hash = dl_gnu_hash(defs[i].name);
+		defs[i].value = s->value;
+	}
+	ld->exports = exports_build(defs, n);
+	if (ld->exports == NULL)
+		goto fail;
+
+	memcpy(image, pl.image, size);
+	prelink_close(&pl);
+	ld->image = image;
+	ld->image_size = size;
+	ld->mapped = 1;
+	ld->relocated = ld->prelinked = 1;
+	TRACE("%s: prelinked @ %p\n", ld->name, image);
+	return 0;
+
+fail:
+	if (image)
+		munmap(image, size ? size : 1);
+	prelink_close(&pl);
+	return -1;
+}
+
+/* Save the relocated image of a module that was just linked */
+static void store_prelinked(struct dl_load *ld)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)ld->sechdrs[ld->symindex].sh_addr;
+	struct dl_exports *ex = ld->si->exports;
+	struct dl_export_def *defs;
+	unsigned i, n = ld->nimports;
+
+	defs = dl_arena_alloc(&ld->arena, (n + ex->nsyms) * sizeof(*defs));
+	if (defs == NULL)
+		return;
+	for (i = 0; i < n; i++) {
+		defs[i].name = ld->strtab + sym[ld->imports[i]].st_name;
+		defs[i].value = ld->symvals[ld->imports[i]];
+	}
+	for (i = 0; i < ex->nsyms; i++) {
+		defs[n + i].name = dl_export_name(ex, i);
+		defs[n + i].value = ex->values[i];
+	}
+	prelink_write(ld->key, ld->si->image, ld->image_size,
+			defs, n, defs + n, ex->nsyms);
+}
+
+/* Turn the prelink cache in dir on, or off with NULL.  Cache keys cover
+ * the system symbols, so that images relocated against one build of the
+ * executable are never used with another.
+ */
+int linker_prelink(const char *dir)
+{
+	struct dl_symbol *entry;
+	uint64_t id = 0;
+
+	if (sysmph)
+		id = prelink_key(sysmph->syms,
+				sysmph->nsyms * sizeof(*sysmph->syms), id);
+	if (sysmap.hdr)
+		id = prelink_key(sysmap.hdr, sysmap.size, id);
+	for (entry = syssyms; entry && entry->name; ++entry) {
+		id = prelink_key(entry->name, strlen(entry->name), id);
+		id = prelink_key(&entry->value, sizeof(entry->value), id);
+	}
+	sysid = id;
+	return prelink_set_dir(dir);
+}
+#endif /* DL_PRELINK */
+
+/* Prepare the object in buf, or read it from the file name if buf is NULL */
+static struct dl_load *prepare_object(const char *name, const void *buf,
+			size_t len, int flags)
+{
+	int fd, i;
+	struct dl_arena arena;
+	struct dl_load *ld;
+	const Elf32_Ehdr *hdr;
+	const Elf32_Shdr *first;
+	Elf32_Shdr *sechdrs, *p;
+	size_t totalsize;
+	unsigned int symindex = 0, shstrndx;
+	char canon[SOINFO_NAME_LEN];
+
+	if (canon_name(name, canon) < 0) {
+		ERROR("library name %s too long\n", name);
+		return NULL;
+	}
+	name = canon;
+	dl_arena_init(&arena);
+	ld = dl_arena_calloc(&arena, 1, sizeof(*ld));
+	if (ld == NULL)
+		return NULL;
+	ld->arena = arena;
+	/* once, dllayout() may change it meanwhile */
+	ld->layout = dl_rcu_dereference(dl_layout);
+	ld->bind_lazy = (flags & RTLD_LAZY) != 0;
+#ifdef DL_LAZY
+	ld->replaceable = (flags & RTLD_REPLACEABLE) != 0;
+#endif
+	strcpy(ld->name, name);
+
+	if (buf) {
+		TRACE("loading %s from %p...\n", name, buf);
+		if (elf_borrow(buf, len, &ld->obj, &ld->arena) < 0)
+			goto fail;
+	} else {
+		fd = open_library(name);
+		if (fd == -1)
+			goto fail;
+		/* Map the whole object once, everything below is parsed in place
+		*/
+		TRACE("mapping %s...\n", name);
+		i = elf_map(fd, &ld->obj, &ld->arena);
+		close(fd);
+		if (i < 0)
+			goto fail;
+	}
+
+	hdr = ld->hdr = (const Elf32_Ehdr *)ld->obj.base;
+	if (verify_elf_object((void *)hdr, name) < 0) {
+        	ERROR("%s is not a valid ELF object\n", name);
+		goto fail;
+	}
+	if (hdr->e_shentsize != sizeof(Elf32_Shdr) ||
+		hdr->e_shoff > ld->obj.size ||
+		ld->obj.size - hdr->e_shoff < sizeof(Elf32_Shdr)) {
+		ERROR("%s: bad section header table\n", name);
+		goto fail;
+	}
+	/* With extended section numbering the real section count and string
+	 * table index are in the first section header.
+	 */
+	first = (const Elf32_Shdr *)(ld->obj.base + hdr->e_shoff);
+	ld->shnum = hdr->e_shnum ? hdr->e_shnum : first->sh_size;
+	shstrndx = hdr->e_shstrndx == SHN_XINDEX ? first->sh_link : hdr->e_shstrndx;
+	if (ld->shnum > (ld->obj.size - hdr->e_shoff) / sizeof(Elf32_Shdr) ||
+		shstrndx >= ld->shnum) {
+		ERROR("%s: bad section header table\n", name);
+		goto fail;
+	}
+
+	/* The section headers are copied since sh_addr is updated below */
+	TRACE("copying %u section headers...\n", ld->shnum);
+	sechdrs = ld->sechdrs = dl_arena_alloc(&ld->arena,
+			ld->shnum * sizeof(Elf32_Shdr));
+	if (sechdrs == NULL)
+		goto fail;
+	memcpy(sechdrs, first, ld->shnum * sizeof(Elf32_Shdr));
+	for (i = 0; i < ld->shnum; i++) {
+		if (!elf_section_ok(&ld->obj, sechdrs + i)) {
+			ERROR("%s: section %d out of bounds\n", name, i);
+			goto fail;
+		}
+		if ((sechdrs[i].sh_flags & (SHF_ALLOC | SHF_TLS)) ==
+				(SHF_ALLOC | SHF_TLS)) {
+			ERROR("%s: thread local storage is not supported\n", name);
+			goto fail;
+		}
+		/* sh_addr from here on is where the section is, or 0 */
+		sechdrs[i].sh_addr = 0;
+	}
+	ld->shstrtbl = ld->obj.base + sechdrs[shstrndx].sh_offset;
+
+	TRACE("collecting info of needed sections...\n");
+	for (i = 0; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		switch (p->sh_type) {
+			case SHT_SYMTAB:
+			case SHT_SYMTAB_SHNDX:
+			case SHT_RELA:
+			case SHT_REL:
+				/* used in place, not part of the image */
+				p->sh_addr = (unsigned long)(ld->obj.base + p->sh_offset);
+				if (p->sh_type == SHT_SYMTAB)
+					symindex = i;
+				break;
+		}
+	}
+	if (symindex == 0 || sechdrs[symindex].sh_link >= ld->shnum) {
+		ERROR("%s: no symbol table\n", name);
+		goto fail;
+	}
+	ld->symindex = symindex;
+	ld->strtab = ld->obj.base + sechdrs[sechdrs[symindex].sh_link].sh_offset;
+	ld->nsyms = sechdrs[symindex].sh_size / sizeof(Elf32_Sym);
+	for (i = 0; i < ld->shnum; i++) {
+		p = sechdrs + i;
+		if (p->sh_type == SHT_SYMTAB_SHNDX && p->sh_link == symindex) {
+			if (p->sh_size < ld->nsyms * sizeof(Elf32_Word)) {
+				ERROR("%s: short extended section index table\n", name);
+				goto fail;
+			}
+			ld->xindex = (const Elf32_Word *)p->sh_addr;
+		}
+	}
+	ld->symvals = dl_arena_calloc(&ld->arena, ld->nsyms, sizeof(Elf32_Addr));
+	ld->imports = dl_arena_alloc(&ld->arena, ld->nsyms * sizeof(unsigned));
+	ld->offsets = dl_arena_alloc(&ld->arena, ld->shnum * sizeof(Elf32_Addr));
+	if (ld->symvals == NULL || ld->imports == NULL || ld->offsets == NULL)
+		goto fail;
+	if ((ld->layout & DL_LAYOUT_GC) && gc_sections(ld) < 0)
+		goto fail;
+	if (classify_sections(ld) < 0)
+		goto fail;
+	if (comdat_groups(ld) < 0)
+		goto fail;
+	if ((ld->layout & DL_LAYOUT_MERGE) && merge_sections(ld) < 0)
+		goto fail;
+	if ((ld->layout & DL_LAYOUT_FOLD) && fold_sections(ld) < 0)
+		goto fail;
+#ifdef DL_LAZY
+	if (ld->bind_lazy && lazy_imports(ld) < 0)
+		goto fail;
+#endif
+	if (dl_profile && order_sections(ld) < 0)
+		goto fail;
+	totalsize = layout_image(ld);
+
+#ifdef DL_PRELINK
+	if (prelink_enabled() && prelinkable(ld) &&
+		load_prelinked(ld, totalsize) == 0) {
+		place_sections(ld);
+		return ld;
+	}
+#endif
+	ld->image = alloc_image(ld, totalsize);
+	if (ld->image == NULL) {
+		ERROR("calloc failed!\n");
+		goto fail;
+	}
+	TRACE("need to load %luB bytes, %luB of them padding\n",
+		(unsigned long)totalsize, (unsigned long)ld->image_pad);
+	copy_sections(ld);
+	if (ld->order)
+		report_layout(ld);
+	if (define_library(ld) < 0)
+		goto fail;
+	return ld;
+
+fail:
+	discard_library(ld);
+	return NULL;
+}
+
+struct dl_load *prepare_library(const char *name, int flags)
+{
+	return prepare_object(name, NULL, 0, flags);
+}
+
+/* The buffer is only used until the load is linked or discarded */
+struct dl_load *prepare_library_mem(const char *name, const void *buf,
+			size_t len, int flags)
+{
+	return prepare_object(name, buf, len, flags);
+}
+
+/* Resolve the imports of a prepared module.  Lookups are safe without
+ * the loader lock, but a module whose exports were used may go away
+ * before this one is committed; link_libraries() notices by comparing
+ * dl_unloads and relocates again.
+ */
+static int resolve_library(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs;
+
+	TRACE("resolving symbols of %s...\n", ld->name);
+	ld->unloads = dl_rcu_dereference(dl_unloads);
+	return resolve_imports((const Elf32_Sym *)sechdrs[ld->symindex].sh_addr,
+			ld->strtab, ld->symvals, ld->imports, ld->nimports,
+			ld->lazysym);
+}
+
+/* Apply the relocation sections of every section in the image */
+static int relocate_library(struct dl_load *ld)
+{
+	Elf32_Shdr *sechdrs = ld->sechdrs;
+	const char *sname;
+	unsigned i;
+
+	TRACE("relocating...\n");
+#ifdef DL_LAZY
+	if (ld->lazy)
+		write_stubs(ld);
+#endif
+	for (i = 1; i < ld->shnum; i++) {
+		if (sechdrs[i].sh_type != SHT_REL && sechdrs[i].sh_type != SHT_RELA)
+			continue;
+		sname = ld->shstrtbl + sechdrs[i].sh_name;
+		if (sechdrs[i].sh_info >= ld->shnum ||
+			section_region(ld, sechdrs[i].sh_info) < 0) {
+			TRACE("skipping %s\n", sname);
+			continue;
+		}
+		if (sechdrs[i].sh_link != ld->symindex) {
+			ERROR("%s: %s uses another symbol table\n", ld->name, sname);
+			return -1;
+		}
+		if (sechdrs[i].sh_type == SHT_REL) {
+			TRACE("SHT_REL relocate %s\n", sname);
+			if (do_relocate(ld, sechdrs, ld->symvals, i))
+				return -1;
+		} else {
+			TRACE("SHT_RELA relocate %s\n", sname);
+			if (do_relocate_addend(ld, sechdrs, ld->symvals, i))
+				return -1;
+		}
+	}
+	ld->relocated = 1;
+	return 0;
+}
+
+typedef void (*dl_func_t)(void);
+
+/* The constructors (fini 0) or destructors (fini 1) of a relocated
+ * module, in the order they run.  Constructors: the .ctors entries
+ * backwards, then the SHT_INIT_ARRAY ones; destructors: the
+ * SHT_FINI_ARRAY entries backwards, then the .dtors ones.  Sections are
+ * taken in object order, priorities are not sorted out.
+ */
+static unsigned *collect_funcs(struct dl_load *ld, int fini, unsigned *count)
+{
+	const char *legacy = fini ? ".dtors" : ".ctors";
+	unsigned type = fini ? SHT_FINI_ARRAY : SHT_INIT_ARRAY;
+	const Elf32_Addr *entry;
+	Elf32_Shdr *p;
+	unsigned *funcs, i, j, k, num, n = 0, pass;
+	int arrays;
+
+	for (i = 1; i < ld->shnum; i++) {
+		p = ld->sechdrs + i;
+		if (section_region(ld, i) < 0)
+			continue;
+		if (p->sh_type == type || !strncmp(ld->shstrtbl + p->sh_name, legacy, 6))
+			n += p->sh_size / sizeof(Elf32_Addr);
+	}
+	*count = 0;
+	if (n == 0)
+		return NULL;
+	funcs = malloc(n * sizeof(unsigned));
+	if (funcs == NULL) {
+		ERROR("malloc failed!\n");
+		return NULL;
+	}
+	for (pass = 0; pass < 2; pass++) {
+		arrays = fini ? pass == 0 : pass == 1;
+		for (k = 1; k < ld->shnum; k++) {
+			/* destructor arrays are walked from the last one */
+			i = arrays && fini ? ld->shnum - k : k;
+			p = ld->sechdrs + i;
+			if (section_region(ld, i) < 0)
+				continue;
+			if (arrays ? p->sh_type != type :
+				strncmp(ld->shstrtbl + p->sh_name, legacy, 6))
+				continue;
+			entry = (const Elf32_Addr *)p->sh_addr;
+			num = p->sh_size / sizeof(Elf32_Addr);
+			for (j = 0; j < num; j++) {
+				/* .ctors backwards, fini arrays backwards */
+				Elf32_Addr f = entry[arrays == fini ? num - 1 - j : j];
+
+				if (f != 0 && f != (Elf32_Addr)-1)
+					funcs[(*count)++] = f;
+			}
+		}
+	}
+	return funcs;
+}
+
+/* Modules whose constructors or destructors are to run, in order, see
+ * run_pending()
+ */
+static soinfo *pending = NULL;
+static soinfo **pending_tail = &pending;
+
+static void queue_library(soinfo *si)
+{
+	si->pending = NULL;
+	*pending_tail = si;
+	pending_tail = &si->pending;
+}
+
+/* Keep the constructors of a module that was just linked for
+ * run_pending(), with a reference to the module until they have run,
+ * and its destructors for unload_library().  Its startup code stays
+ * until then too, otherwise it is freed with the load.
+ */
+static void init_library(struct dl_load *ld)
+{
+	soinfo *si = ld->si;
+
+	si->init_array = collect_funcs(ld, 0, &si->init_array_count);
+	si->fini_array = collect_funcs(ld, 1, &si->fini_array_count);
+	if (si->init_array_count == 0) {
+		free(si->init_array);
+		si->init_array = NULL;
+		if (ld->text[TEXT_STARTUP])
+			INFO("%s: %lu bytes of startup code released\n",
+				ld->name, (unsigned long)ld->text_size[TEXT_STARTUP]);
+		return;
+	}
+	si->text[TEXT_STARTUP] = ld->text[TEXT_STARTUP];
+	si->text_size[TEXT_STARTUP] = ld->text_size[TEXT_STARTUP];
+	ld->text[TEXT_STARTUP] = NULL;
+	si->refcount++;
+	queue_library(si);
+}
+
+static void run_funcs(soinfo *si, const unsigned *funcs, unsigned n,
+			const char *what)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		TRACE("%s: %s @ 0x%x\n", si->name, what, funcs[i]);
+		((dl_func_t)(unsigned long)funcs[i])();
+	}
+}
+
+static void finish_unload(soinfo *si);
+
+/* Unload the replaced modules no thread can be running in any more */
+static void reclaim_retired(void)
+{
+	soinfo **pp = &retired, *si;
+
+	while ((si = *pp)) {
+		if (dl_grace_over(si->retired)) {
+			*pp = si->retired_next;
+			si->retired_next = NULL;
+			INFO("%s: replaced version released\n", si->name);
+			unload_library(si);
+		} else {
+			pp = &si->retired_next;
+		}
+	}
+}
+
+/* Whether a replaced module waits for threads to be quiescent */
+int linker_retiring(void)
+{
+	return dl_rcu_dereference(retired) != NULL;
+}
+
+/* Run the constructors queued by link_libraries() and the destructors
+ * queued by unload_library() without the loader lock, they may load and
+ * unload modules themselves.  Then drop the references init_library()
+ * took and free what was unloaded.  Called with the lock held, which is
+ * dropped meanwhile.
+ */
+static void run_pending(void)
+{
+	soinfo *list, *si, *next;
+
+	reclaim_retired();
+	while ((list = pending)) {
+		pending = NULL;
+		pending_tail = &pending;
+		dl_write_unlock();
+		for (si = list; si; si = si->pending) {
+			if (si->init_array)
+				run_funcs(si, si->init_array, si->init_array_count,
+					"constructor");
+			else
+				run_funcs(si, si->fini_array, si->fini_array_count,
+					"destructor");
+		}
+		dl_write_lock();
+		for (si = list; si; si = next) {
+			next = si->pending;
+			si->pending = NULL;
+			if (si->init_array == NULL) {
+				finish_unload(si);
+				continue;
+			}
+			free(si->init_array);
+			si->init_array = NULL;
+			si->init_array_count = 0;
+			if (si->text[TEXT_STARTUP]) {
+				INFO("%s: %lu bytes of startup code released\n",
+					si->name,
+					(unsigned long)si->text_size[TEXT_STARTUP]);
+				free_text(si->text[TEXT_STARTUP],
+					si->text_size[TEXT_STARTUP], TEXT_STARTUP,
+					(si->flags & FLAG_POOLED) != 0);
+				si->text[TEXT_STARTUP] = NULL;
+			}
+			unload_library(si);
+		}
+	}
+}
+
+/* Leave the loader, running the constructors and destructors of what
+ * was loaded and unloaded first, see run_pending().  Instead of
+ * dl_write_unlock() wherever modules may have come or gone.
+ */
+void linker_unlock(void)
+{
+	run_pending();
+	dl_write_unlock();
+}
+
+/* Bring prepared modules in.  All their exports are published before any
+ * of them is resolved, so they may refer to each other; modules relocated
+ * beforehand are only done again if something was unloaded since.  Either
+ * all are linked, their handles going to handles[], or none is; the loads
+ * are consumed in both cases.  The constructors of linked modules are
+ * queued in order, they run once the loader is left, see linker_unlock().
+ * Called with the loader lock held.
+ */
+int link_libraries(struct dl_load **lds, unsigned n, soinfo **handles)
+{
+	struct dl_load *ld;
+	soinfo *si;
+	unsigned i, j;
+	int t, ret = -1;
+
+	for (i = 0; i < n; i++) {
+		ld = lds[i];
+		si = alloc_info(ld->name);
+		if (si == NULL)
+			goto out;
+		/* the image stays in ld too until it is linked, copy_sections()
+		 * may need it again
+		 */
+		si->image = ld->image;
+		si->image_size = ld->image_size;
+		si->image_pad = ld->image_pad;
+		for (t = TEXT_HOT; t < NTEXTS; t++) {
+			si->text[t] = ld->text[t];
+			si->text_size[t] = ld->text_size[t];
+		}
+		si->bss = ld->bss;
+		si->bss_size = ld->bss_size;
+		si->merged = ld->merged;
+		si->nmerged = ld->nmerged;
+		si->lazy = ld->lazy;
+		if (ld->mapped)
+			si->flags |= FLAG_MAPPED;
+		if (ld->pooled)
+			si->flags |= FLAG_POOLED;
+		si->exports = ld->exports;
+		ld->exports = NULL;
+		ld->si = si;
+		if (ld->ndropped + ld->nfolded + ld->nneeds) {
+			si->owners = malloc((ld->ndropped + ld->nfolded +
+					ld->nneeds) * sizeof(soinfo *));
+			if (si->owners == NULL)
+				goto out;
+		}
+#ifdef DL_LAZY
+		if (ld->replaceable && make_trampolines(ld, si) < 0)
+			goto out;
+#endif
+		if (publish_exports(si) < 0 || link_groups(ld, si) < 0)
+			goto out;
+	}
+	for (i = 0; i < n; i++) {
+		ld = lds[i];
+		if (ld->relocated) {
+			if (ld->unloads == dl_unloads)
+				continue;
+			TRACE("modules went away, relocating %s again\n", ld->name);
+			copy_sections(ld);
+			ld->relocated = 0;
+			if (ld->prelinked) {
+				ld->prelinked = 0;
+				if (define_library(ld) < 0)
+					goto out;
+			}
+		}
+		if (resolve_library(ld) < 0 || relocate_library(ld) < 0)
+			goto out;
+	}
+	for (i = 0; i < n; i++) {
+		ld = lds[i];
+		if (link_folds(ld, ld->si) < 0)
+			goto out;
+#ifdef DL_LAZY
+		if (hold_bound(ld, ld->si) < 0)
+			goto out;
+#endif
+#ifdef DL_POOLS
+		/* W^X: the text is not written from here on */
+		for (t = 0; ld->pooled && t < NTEXTS; t++) {
+			if (ld->text[t] && dl_pool_seal(&textpools[t], ld->text[t],
+					ld->text_size[t]) < 0)
+				goto out;
+		}
+#endif
+		ld->si->flags |= FLAG_LINKED;
+	}
+	TRACE("DONE\n");
+	for (i = 0; i < n; i++) {
+		/* the modules autoloaded for it, and those holding the groups
+		 * and functions it uses, stay until it goes
+		 */
+		for (j = 0; j < lds[i]->nneeds; j++) {
+			si = find_loaded_library(lds[i]->needs[j]);
+			if (si && si != lds[i]->si)
+				hold_owner(lds[i]->si, si);
+		}
+		for (j = 0; j < lds[i]->si->nowners; j++)
+			lds[i]->si->owners[j]->refcount++;
+		init_library(lds[i]);
+	}
+	ret = 0;
+
+out:
+	for (i = 0; i < n; i++) {
+		ld = lds[i];
+		/* all but the startup code is the soinfo's now */
+		if (ld->si) {
+			ld->image = NULL;
+			ld->bss = NULL;
+			ld->merged = NULL;
+			ld->nmerged = 0;
+			ld->lazy = NULL;
+			for (t = TEXT_HOT; t < NTEXTS; t++)
+				ld->text[t] = NULL;
+		}
+		if (ret == 0) {
+			handles[i] = ld->si;
+			INFO("%s: %lu byte image, %lu bytes of padding\n", ld->name,
+				(unsigned long)ld->image_size,
+				(unsigned long)ld->image_pad);
+#ifdef DL_PRELINK
+			if (ld->mapped && !ld->prelinked && prelinkable(ld))
+				store_prelinked(ld);
+#endif
+		} else if (ld->si) {
+			free_info(ld->si);
+			release_image(ld->si);
+		}
+		discard_library(ld);
+	}
+	return ret;
+}
+
+struct dl_autoload
+{
+	const char **names;
+	struct dl_load **lds;
+	int flags;
+};
+
+static void autoload_one(void *arg, unsigned i)
+{
+	struct dl_autoload *a = arg;
+
+	a->lds[i] = prepare_object(a->names[i], NULL, 0, a->flags);
+}
+
+/* Prepare the objects defining what ld is missing, see linker_autoload(),
+ * then those defining what they are missing, and so on, each wave in
+ * parallel.  They are plain modules, of flags only RTLD_LAZY is passed
+ * on.  The imports of each load that made a module come in are in its
+ * needs[].  Returns the loads, ld first, and their number in *n.
+ */
+static struct dl_load **autoload_deps(struct dl_load *ld, int flags,
+			unsigned *n)
+{
+	struct dl_load **all, **more, *l;
+	struct dl_autoload a;
+	const Elf32_Sym *sym;
+	const char *name, *path;
+	unsigned i, j, k, start = 0, nall = 1, nnames;
+	char *copy;
+
+	all = malloc(sizeof(*all));
+	if (all == NULL)
+		return NULL;
+	all[0] = ld;
+	a.flags = flags & RTLD_LAZY;
+	for (;;) {
+		a.names = NULL;
+		nnames = 0;
+		for (i = start; i < nall; i++)
+			nnames += all[i]->nimports;
+		a.names = dl_arena_alloc(&ld->arena, (nnames + 1) * sizeof(char *));
+		if (a.names == NULL)
+			goto fail;
+		nnames = 0;
+
+		dl_read_lock();
+		for (i = start; i < nall; i++) {
+			l = all[i];
+			sym = (const Elf32_Sym *)l->sechdrs[l->symindex].sh_addr;
+			for (j = 0; j < l->nimports; j++) {
+				name = l->strtab + sym[l->imports[j]].st_name;
+				if (lookup_global_symbol(name) ||
+					(path = provider_of(name)) == NULL ||
+					!strcmp(path, l->name))
+					continue;
+				if (l->needs == NULL)
+					l->needs = dl_arena_alloc(&l->arena,
+						l->nimports * sizeof(char *));
+				copy = dl_arena_alloc(&l->arena, strlen(path) + 1);
+				if (l->needs == NULL || copy == NULL) {
+					dl_read_unlock();
+					goto fail;
+				}
+				l->needs[l->nneeds++] = strcpy(copy, path);
+				for (k = 0; k < nall && strcmp(all[k]->name, path); k++)
+					;
+				if (k < nall)
+					continue;
+				for (k = 0; k < nnames && strcmp(a.names[k], path); k++)
+					;
+				if (k == nnames) {
+					TRACE("%s needs %s for %s\n", l->name, path, name);
+					a.names[nnames++] = copy;
+				}
+			}
+		}
+		dl_read_unlock();
+		if (nnames == 0)
+			break;
+
+		more = realloc(all, (nall + nnames) * sizeof(*all));
+		if (more == NULL)
+			goto fail;
+		all = more;
+		a.lds = all + nall;
+		dl_parallel(nnames, autoload_one, &a);
+		start = nall;
+		nall += nnames;
+		for (i = start; i < nall; i++) {
+			if (all[i] == NULL)
+				goto fail;
+		}
+	}
+	*n = nall;
+	return all;
+
+fail:
+	for (i = 1; i < nall; i++) {
+		if (all[i])
+			discard_library(all[i]);
+	}
+	free(all);
+	return NULL;
+}
+
+/* The loads of the objects ld needs, see autoload_deps(); NULL when
+ * nothing is indexed or ld is prelinked.  Called without the loader lock.
+ */
+struct dl_load **prepare_deps(struct dl_load *ld, int flags, unsigned *n)
+{
+	if (ld->relocated || dl_rcu_dereference(dl_providers) == NULL)
+		return NULL;
+	return autoload_deps(ld, flags, n);
+}
+
+/* Discard the loads from lds[start] on whose modules were loaded meanwhile
+ * or come earlier in lds; returns how many loads are left.  Called with
+ * the loader lock held.
+ */
+unsigned drop_loaded(struct dl_load **lds, unsigned start, unsigned n)
+{
+	unsigned i, j, k;
+
+	for (i = j = start; i < n; i++) {
+		for (k = 0; k < j && strcmp(lds[k]->name, lds[i]->name); k++)
+			;
+		if (k < j || find_loaded_library(lds[i]->name))
+			discard_library(lds[i]);
+		else
+			lds[j++] = lds[i];
+	}
+	return j;
+}
+
+/* Entered and left with the loader lock held, which is dropped while the
+ * object is read, parsed and relocated.  Someone else may have loaded the
+ * same module meanwhile, theirs is used then.
+ */
+static soinfo *
+load_library(const char *name, const void *buf, size_t len, int flags)
+{
+	struct dl_load *ld, **lds = NULL;
+	soinfo *si, **handles;
+	unsigned i, n = 1;
+	int ret = -1;
+
+	dl_write_unlock();
+	ld = prepare_object(name, buf, len, flags);
+	if (ld && ld->relocated) {
+		ret = 0;	/* prelinked */
+	} else if (ld && (lds = prepare_deps(ld, flags, &n)) && n > 1) {
+		ret = 0;	/* link_libraries() resolves them together */
+	} else if (ld) {
+		dl_read_lock();
+		ret = resolve_library(ld);
+		dl_read_unlock();
+		if (ret == 0)
+			ret = relocate_library(ld);
+	}
+	dl_write_lock();
+
+	if (ld == NULL)
+		return NULL;
+	if (lds == NULL) {
+		lds = &ld;
+		n = 1;
+	}
+	si = ret < 0 || (flags & DL_REPLACING) ? NULL :
+		find_loaded_library(name);
+	if (ret < 0 || si) {
+		if (si)
+			TRACE("[ '%s' was loaded meanwhile ]\n", name);
+		for (i = 0; i < n; i++)
+			discard_library(lds[i]);
+		goto out;
+	}
+	/* modules autoloaded by someone else meanwhile */
+	n = drop_loaded(lds, 1, n);
+	handles = n > 1 ? malloc(n * sizeof(*handles)) : &si;
+	if (handles == NULL) {
+		for (i = 0; i < n; i++)
+			discard_library(lds[i]);
+		goto out;
+	}
+	if (link_libraries(lds, n, handles) == 0)
+		si = handles[0];
+	if (handles != &si)
+		free(handles);
+out:
+	if (lds != &ld)
+		free(lds);
+	return si;
+}
+
+/* Whether an object indexed by linker_autoload() defines name.  Readers
+ * only.
+ */
+int linker_provides(const char *name)
+{
+	return provider_of(name) != NULL;
+}
+
+/* dlsym() found nothing for name: load the object defining it, if it is
+ * indexed, see linker_autoload().  It stays loaded.  Called with the
+ * loader lock held.
+ */
+unsigned long autoload_symbol(const char *name)
+{
+	const char *path = provider_of(name);
+	char copy[SOINFO_NAME_LEN];
+	soinfo *si;
+
+	if (path == NULL)
+		return 0;
+	/* the lock is dropped while loading, the index may change */
+	strcpy(copy, path);
+	TRACE("autoloading %s for %s\n", copy, name);
+	si = find_library(copy, RTLD_NOW);
+	if (si == NULL)
+		return 0;
+	if (!(si->flags & FLAG_AUTOLOADED)) {
+		si->flags |= FLAG_AUTOLOADED;
+		si->refcount++;
+	}
+	return lookup_global_symbol(name);
+}
+
+/* Whether a and b name the same module, see canon_name() */
+int same_library(const char *a, const char *b)
+{
+	char ca[SOINFO_NAME_LEN], cb[SOINFO_NAME_LEN];
+
+	if (canon_name(a, ca) < 0 || canon_name(b, cb) < 0)
+		return !strcmp(a, b);
+	return !strcmp(ca, cb);
+}
+
+/* The module named canon, whatever its state */
+static soinfo *lookup_module(const char *canon)
+{
+	const struct symhash_entry *e;
+
+	e = symhash_lookup(&modules, canon, dl_gnu_hash(canon));
+	return e ? (soinfo *)e->value : NULL;
+}
+
+/* The module loaded under name, if any */
+soinfo *find_loaded_library(const char *name)
+{
+	char canon[SOINFO_NAME_LEN];
+	soinfo *si;
+
+	if (canon_name(name, canon) < 0)
+		return NULL;
+	si = lookup_module(canon);
+	return si && !(si->flags & FLAG_ERROR) ? si : NULL;
+}
+
+static soinfo *find_object(const char *name, const void *buf, size_t len,
+			int flags)
+{
+	char canon[SOINFO_NAME_LEN];
+	soinfo *si;
+
+	if (canon_name(name, canon) < 0) {
+		ERROR("library name %s too long\n", name);
+		return NULL;
+	}
+	si = lookup_module(canon);
+	/* the version being replaced */
+	if(si && (flags & DL_REPLACING)) si = NULL;
+	if(si) {
+		if(si->flags & FLAG_ERROR) return 0;
+		if(si->flags & FLAG_LINKED) return si;
+		ERROR("OOPS: recursive link to '%s'\n", si->name);
+		return 0;
+	}
+
+	TRACE("[ '%s' has not been loaded yet.  Locating...]\n", name);
+	si = load_library(canon, buf, len, flags);
+	if(si == NULL)
+		return NULL;
+//	return init_library(si);
+	return si;
+}
+
+soinfo *find_library(const char *name, int flags)
+{
+	return find_object(name, NULL, 0, flags);
+}
+
+soinfo *find_library_mem(const char *name, const void *buf, size_t len,
+			int flags)
+{
+	return find_object(name, buf, len, flags);
+}
+
+/* The destructors of si have run */
+static void finish_unload(soinfo *si)
+{
+	soinfo **owners = si->owners;
+	unsigned i, nowners = si->nowners;
+
+	free(si->fini_array);
+	si->fini_array = NULL;
+	si->fini_array_count = 0;
+	si->owners = NULL;
+	free_info(si);
+	release_image(si);
+	/* drop the modules holding its COMDAT groups and functions */
+	for (i = 0; i < nowners; i++)
+		unload_library(owners[i]);
+	free(owners);
+}
+
+/* Drop a reference to si.  With the last one it is withdrawn from the
+ * indexes at once, and goes once its destructors have run, see
+ * run_pending().  Called with the loader lock held.
+ */
+unsigned unload_library(soinfo *si)
+{
+	if (si->refcount == 1) {
+		si->refcount = 0;
+		withdraw_library(si);
+		if (si->fini_array)
+			queue_library(si);
+		else
+			finish_unload(si);
+	} else {
+		si->refcount--;
+		PRINT("not unloading '%s', decrementing refcount to %d\n",
+			si->name, si->refcount);
+	}
+	return si->refcount;
+}
+
+/* Build the global symbol index, seeded with the system symbols */
+static void index_system_symbols(void)
+{
+	struct dl_symbol *entry;
+	unsigned count = 0;
+
+	for (entry = syssyms; entry->name; ++entry)
+		++count;
+	if (symhash_init(&globalsyms, count) < 0) {
+		ERROR("No Memory\n");
+		exit(-1);
+	}
+	for (entry = syssyms; entry->name; ++entry) {
+		if (symhash_insert(&globalsyms, entry->name,
+				dl_gnu_hash(entry->name), entry->value, NULL) < 0) {
+			ERROR("No Memory\n");
+			exit(-1);
+		}
+	}
+	TRACE("%u system symbols indexed\n", count);
+}
+
+/* Read the core symbols and initialize.  A compiled in symbol table
+ * takes precedence (the perfect hash cexpSystemSymtab, or the older
+ * cexpSystemSymbols array), then the binary map at mapfile, which is
+ * used in place, and finally the gzipped 'nm' output in symfile.
+ */
+void __linker_init(const char *mapfile, const char *symfile)
+{
+	gzFile gzfile;
+	char buf[BUFSIZ/2];
+	char otype, *rest;
+	unsigned long val;
+	int count = 0;
+	struct dl_symbol *entry;
+
+	if (symhash_init(&comdats, 0) < 0 || symhash_init(&modules, 0) < 0) {
+		ERROR("No Memory\n");
+		exit(-1);
+	}
+	if (&cexpSystemSymtab) {
+		sysmph = &cexpSystemSymtab;
+		TRACE("%u compiled in system symbols\n", sysmph->nsyms);
+	}
+	if (cexpSystemSymbols) {
+		syssyms = cexpSystemSymbols;
+		index_system_symbols();
+		return;
+	}
+	if (sysmph || sysmap_open(mapfile, &sysmap) == 0) {
+		/* only module exports go into the global index */
+		if (symhash_init(&globalsyms, 0) < 0) {
+			ERROR("No Memory\n");
+			exit(-1);
+		}
 		return;
 	}
-	gzfile = gzopen(filename, "rb");
+	gzfile = gzopen(symfile, "rb");
 	if (gzfile == NULL) {
-		ERROR("error gzopen sym file:%s\n", filename);
+		ERROR("error gzopen sym file:%s\n", symfile);
 		exit(-1);
 	}
 	
@@ -702,4 +4200,5 @@ void __linker_init(char *filename)
 	}
 
 	gzclose(gzfile);
+	index_system_symbols();
 }
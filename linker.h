@@ -39,13 +39,78 @@
 #include <linux/elf.h>
 #endif
 
+/* not in every <linux/elf.h> */
+#ifndef SHT_INIT_ARRAY
+#define SHT_INIT_ARRAY      14
+#define SHT_FINI_ARRAY      15
+#define SHT_PREINIT_ARRAY   16
+#endif
+#ifndef SHT_GROUP
+#define SHT_GROUP           17
+#define GRP_COMDAT          1
+#endif
+#ifndef SHT_SYMTAB_SHNDX
+#define SHT_SYMTAB_SHNDX    18
+#endif
+#ifndef SHF_MERGE
+#define SHF_MERGE           0x00000010
+#endif
+#ifndef SHF_STRINGS
+#define SHF_STRINGS         0x00000020
+#endif
+#ifndef SHF_LINK_ORDER
+#define SHF_LINK_ORDER      0x00000080
+#endif
+#ifndef SHF_GROUP
+#define SHF_GROUP           0x00000200
+#endif
+#ifndef SHF_TLS
+#define SHF_TLS             0x00000400
+#endif
+#ifndef SHN_XINDEX
+#define SHN_XINDEX          0xffff
+#endif
+
 #define FLAG_LINKED     0x00000001
 #define FLAG_ERROR      0x00000002
 #define FLAG_EXE        0x00000004 // The main executable
 #define FLAG_PRELINKED  0x00000008 // This is a pre-linked lib
+#define FLAG_PUBLISHED  0x00000010 // Exports are in the global namespace
+#define FLAG_MAPPED     0x00000020 // The image is mmap()ed
+#define FLAG_POOLED     0x00000040 // Text and image are from the pools
+#define FLAG_AUTOLOADED 0x00000080 // Holds a reference of its own
+#define FLAG_REPLACING  0x00000100 // A new version is being loaded
+
+/* find_library() flag besides the RTLD_ ones: pass over the loaded module
+ * of that name, it is being replaced, see replace_library()
+ */
+#define DL_REPLACING    0x00010000
 
 #define SOINFO_NAME_LEN 128
 
+/* for laying out module images, see layout_image() */
+#ifdef __sparc__
+#define DL_CACHELINE    32
+#else
+#define DL_CACHELINE    64
+#endif
+#define DL_PAGE_SIZE    4096
+#define DL_BSS_MAP      (64 * 1024) // larger bss is mapped on its own
+
+/* Map object files instead of reading them section by section.
+ * RTEMS has no mmap(), it reads the whole file in one go instead.
+ */
+#ifdef __linux__
+#define DL_USE_MMAP
+#endif
+
+/* Calls can go through stubs bound on first use, for RTLD_LAZY and
+ * RTLD_DEFER, see lazy_imports() and open_plugin()
+ */
+#ifdef __i386__
+#define DL_LAZY
+#endif
+
 #define ANDROID_X86_LINKER
 #ifdef ANDROID_ARM_LINKER
 
@@ -70,6 +135,9 @@
 */
 #define R_ARM_ABS32      2
 
+/* Pieces of module text apart from the image, see layout_image() */
+enum { TEXT_STARTUP, TEXT_HOT, TEXT_NORMAL, TEXT_COLD, NTEXTS };
+
 typedef struct soinfo soinfo;
 
 struct soinfo
@@ -77,8 +145,27 @@ struct soinfo
     const char name[SOINFO_NAME_LEN];
 
     soinfo *next;
+    soinfo *pending;        // queued for its constructors or destructors
+    soinfo *retired_next;   // replaced, see replace_library()
+    unsigned long retired;  // the grace period it waits for
     unsigned flags;
     char *image;
+    size_t image_size;
+    size_t image_pad;       // bytes of alignment padding in the image
+    char *text[NTEXTS];     // with FLAG_POOLED, the text, apart from the image
+    size_t text_size[NTEXTS];
+    char *bss;              // a large bss, mapped apart from the image
+    size_t bss_size;
+    struct dl_merge_entry **merged; // contents shared through the merge pool
+    unsigned nmerged;
+    char *groups;           // signatures of the COMDAT groups it holds
+    unsigned ngroups;
+    struct dl_fold **folds; // its functions others may fold onto
+    unsigned nfolds;
+    soinfo **owners;        // holding COMDAT groups or functions it uses
+    struct dl_lazy *lazy;   // stubs of the functions bound on first call
+    struct dl_lazy *tramps; // trampolines of its functions, RTLD_REPLACEABLE
+    unsigned nowners;
 
     unsigned *preinit_array;
     unsigned preinit_array_count;
@@ -92,13 +179,50 @@ struct soinfo
     void (*fini_func)(void);
 
     unsigned refcount;
-    struct dl_symbol_list *dlsyms;
+    struct dl_exports *exports;
 };
 
 
-soinfo *find_library(const char *name);
+/* Called with the loader lock held, which is dropped while a new module
+ * is read and relocated.
+ */
+soinfo *find_library(const char *name, int flags);
+/* Same, with the object in buf, which is not used after the call */
+soinfo *find_library_mem(const char *name, const void *buf, size_t len,
+			int flags);
+soinfo *find_loaded_library(const char *name);
+int same_library(const char *a, const char *b);
+
+/* Loading in two steps, see linker.c */
+struct dl_load;
+struct dl_load *prepare_library(const char *name, int flags);
+struct dl_load *prepare_library_mem(const char *name, const void *buf,
+			size_t len, int flags);
+void discard_library(struct dl_load *ld);
+int link_libraries(struct dl_load **lds, unsigned n, soinfo **handles);
+struct dl_load **prepare_deps(struct dl_load *ld, int flags, unsigned *n);
+unsigned drop_loaded(struct dl_load **lds, unsigned start, unsigned n);
+
 unsigned unload_library(soinfo *si);
+void linker_unlock(void);
+int linker_retiring(void);
 unsigned long lookup_in_library(soinfo *si, const char *name);
 unsigned long lookup(const char *name);
+void __linker_init(const char *mapfile, const char *symfile);
+int linker_prelink(const char *dir);
+unsigned linker_layout(unsigned flags);
+int linker_profile(const char *file);
+int linker_autoload(const char *dir);
+int linker_provides(const char *name);
+unsigned long autoload_symbol(const char *name);
+
+#ifdef DL_LAZY
+struct dl_plugin;
+void *open_plugin(const char *name);
+struct dl_plugin *find_plugin(const void *handle);
+unsigned long lookup_in_plugin(struct dl_plugin *p, const char *name);
+unsigned close_plugin(struct dl_plugin *p);
+soinfo *replace_library(soinfo *old, const char *name);
+#endif
 
 #endif
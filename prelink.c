@@ -0,0 +1,209 @@
+/* Prelink cache, see prelink.h for the file layout
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "prelink.h"
+#include "symhash.h"
+#include "linker_debug.h"
+
+#ifdef DL_PRELINK
+#include <sys/mman.h>
+
+#define PRELINK_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+
+static char prelink_dir[256];
+
+int prelink_set_dir(const char *dir)
+{
+	if (dir == NULL) {
+		prelink_dir[0] = '\0';
+		return 0;
+	}
+	if (strlen(dir) >= sizeof(prelink_dir)) {
+		ERROR("prelink cache path %s too long\n", dir);
+		return -1;
+	}
+	strcpy(prelink_dir, dir);
+	return 0;
+}
+
+int prelink_enabled(void)
+{
+	return prelink_dir[0] != '\0';
+}
+
+/* 64 bit FNV-1a */
+uint64_t prelink_key(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = data;
+	uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+
+	while (size--) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static void prelink_path(char *buf, size_t len, uint64_t key)
+{
+	snprintf(buf, len, "%s/%016llx.dlc", prelink_dir,
+			(unsigned long long)key);
+}
+
+int prelink_open(uint64_t key, struct prelink *pl)
+{
+	char path[320];
+	struct stat filestat;
+	const struct prelink_header *hdr;
+	size_t off;
+	void *buf;
+	uint64_t i, n;
+	int fd;
+
+	prelink_path(path, sizeof(path), key);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &filestat) < 0 ||
+		filestat.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+	pl->size = filestat.st_size;
+	buf = mmap(NULL, pl->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return -1;
+
+	hdr = pl->hdr = buf;
+	off = sizeof(*hdr) + PRELINK_ALIGN(hdr->size);
+	if (hdr->magic != PRELINK_MAGIC || hdr->version != PRELINK_VERSION ||
+		hdr->key != key || off > pl->size ||
+		(pl->size - off) / sizeof(struct prelink_sym) <
+			(uint64_t)hdr->nimports + hdr->nexports ||
+		pl->size - off - (hdr->nimports + hdr->nexports) *
+			sizeof(struct prelink_sym) < hdr->strsize) {
+		goto bad;
+	}
+	pl->image = (const char *)buf + sizeof(*hdr);
+	pl->imports = (const struct prelink_sym *)((const char *)buf + off);
+	pl->exports = pl->imports + hdr->nimports;
+	pl->strings = (const char *)(pl->exports + hdr->nexports);
+	/* every name is a string within strings[] */
+	n = (uint64_t)hdr->nimports + hdr->nexports;
+	if (n && (hdr->strsize == 0 || pl->strings[hdr->strsize - 1] != '\0'))
+		goto bad;
+	for (i = 0; i < n; i++) {
+		if (pl->imports[i].name >= hdr->strsize)
+			goto bad;
+	}
+	TRACE("prelinked image %s: %u bytes @ 0x%llx\n", path, hdr->size,
+		(unsigned long long)hdr->base);
+	return 0;
+
+bad:
+	ERROR("%s: bad prelink cache file\n", path);
+	munmap(buf, pl->size);
+	return -1;
+}
+
+void prelink_close(struct prelink *pl)
+{
+	if (pl->hdr)
+		munmap((void *)pl->hdr, pl->size);
+	pl->hdr = NULL;
+}
+
+static int prelink_syms(int fd, const struct dl_export_def *defs, unsigned n,
+		uint32_t *strsize)
+{
+	struct prelink_sym s;
+	unsigned i;
+
+	s.pad = 0;
+	for (i = 0; i < n; i++) {
+		s.name = *strsize;
+		s.value = defs[i].value;
+		*strsize += strlen(defs[i].name) + 1;
+		if (write(fd, &s, sizeof(s)) != sizeof(s))
+			return -1;
+	}
+	return 0;
+}
+
+static int prelink_strings(int fd, const struct dl_export_def *defs, unsigned n)
+{
+	unsigned i;
+	size_t len;
+
+	for (i = 0; i < n; i++) {
+		len = strlen(defs[i].name) + 1;
+		if (write(fd, defs[i].name, len) != (ssize_t)len)
+			return -1;
+	}
+	return 0;
+}
+
+/* Written to a temporary file first, so that readers only ever see
+ * complete cache files.
+ */
+int prelink_write(uint64_t key, const void *image, size_t size,
+		const struct dl_export_def *imports, unsigned nimports,
+		const struct dl_export_def *exports, unsigned nexports)
+{
+	static const char zeros[8];
+	char path[320], tmp[330];
+	struct prelink_header hdr;
+	size_t pad = PRELINK_ALIGN(size) - size;
+	int fd;
+
+	prelink_path(path, sizeof(path), key);
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		ERROR("cannot create %s\n", tmp);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PRELINK_MAGIC;
+	hdr.version = PRELINK_VERSION;
+	hdr.key = key;
+	hdr.base = (unsigned long)image;
+	hdr.size = size;
+	hdr.nimports = nimports;
+	hdr.nexports = nexports;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		write(fd, image, size) != (ssize_t)size ||
+		write(fd, zeros, pad) != (ssize_t)pad ||
+		prelink_syms(fd, imports, nimports, &hdr.strsize) < 0 ||
+		prelink_syms(fd, exports, nexports, &hdr.strsize) < 0 ||
+		prelink_strings(fd, imports, nimports) < 0 ||
+		prelink_strings(fd, exports, nexports) < 0 ||
+		pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		ERROR("cannot write %s\n", tmp);
+		goto fail;
+	}
+	close(fd);
+	if (rename(tmp, path) < 0) {
+		ERROR("cannot rename %s\n", tmp);
+		unlink(tmp);
+		return -1;
+	}
+	TRACE("prelinked image written to %s\n", path);
+	return 0;
+
+fail:
+	close(fd);
+	unlink(tmp);
+	return -1;
+}
+
+#endif /* DL_PRELINK */
@@ -0,0 +1,73 @@
+/* Prelink cache
+ *
+ * Optionally, relocated module images are kept in a cache directory,
+ * one file per object, named after a key over the object's contents and
+ * the system symbol table.  A later load of the same object that gets
+ * the image address recorded in the file copies the image in and skips
+ * symbol resolution and relocation; the recorded imports are looked up
+ * again to make sure they still resolve to the same values.  Native byte
+ * order, never shared between hosts.
+ *
+ *   struct prelink_header
+ *   char                  image[size]        padded to 8 bytes
+ *   struct prelink_sym    imports[nimports]
+ *   struct prelink_sym    exports[nexports]
+ *   char                  strings[strsize]
+ */
+#ifndef _LINKER_PRELINK_H_
+#define _LINKER_PRELINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linker.h"
+
+/* only where objects can be mapped at a requested address */
+#ifdef DL_USE_MMAP
+#define DL_PRELINK
+#endif
+
+#define PRELINK_MAGIC	0x4c44504cU	/* "LDPL" */
+#define PRELINK_VERSION	2
+
+struct prelink_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t base;		/* address the image was relocated for */
+	uint32_t size;		/* of the image */
+	uint32_t nimports;
+	uint32_t nexports;
+	uint32_t strsize;
+};
+
+struct prelink_sym
+{
+	uint32_t name;		/* offset into strings */
+	uint32_t pad;
+	uint64_t value;
+};
+
+struct prelink
+{
+	const struct prelink_header *hdr;
+	const char *image;
+	const struct prelink_sym *imports;
+	const struct prelink_sym *exports;
+	const char *strings;
+	size_t size;
+};
+
+struct dl_export_def;
+
+int prelink_set_dir(const char *dir);
+int prelink_enabled(void);
+uint64_t prelink_key(const void *data, size_t size, uint64_t seed);
+int prelink_open(uint64_t key, struct prelink *pl);
+void prelink_close(struct prelink *pl);
+int prelink_write(uint64_t key, const void *image, size_t size,
+		const struct dl_export_def *imports, unsigned nimports,
+		const struct dl_export_def *exports, unsigned nexports);
+
+#endif
@@ -1,14 +1,57 @@
 #ifndef _LINKER_SYM_H_
 #define _LINKER_SYM_H_
+
+#include <stdint.h>
+
 struct dl_symbol
 {
         char *name;
         unsigned long value;
 };
-struct dl_symbol_list
+
+/* Compiled in system symbol table, generated by tools/mydeps or
+ * 'ldep -C' as cexpSystemSymtab.  The names live in one string blob and
+ * are referenced by 32 bit offsets, and the slots are indexed by a
+ * minimal perfect hash:
+ *
+ *	d = disp[dl_gnu_hash(name) % nbuckets]
+ *	slot = d < 0 ? -d - 1 : dl_mph_hash(d, name) % nsyms
+ *
+ * A bucket with d == 0 is empty.  The name in the slot must still be
+ * compared, since the hash maps names outside the set somewhere too.
+ */
+struct dl_mph_sym
 {
-	struct dl_symbol sym;
-	struct dl_symbol_list *next;
+	uint32_t name;		/* offset into names */
+	unsigned long value;
 };
 
+struct dl_mph_table
+{
+	uint32_t nsyms;
+	uint32_t nbuckets;
+	const int32_t *disp;
+	const struct dl_mph_sym *syms;
+	const char *names;
+};
+
+/* FNV-1a seeded with the displacement, plus a final avalanche since
+ * the low bits of plain FNV do not depend on the seed at all */
+static inline uint32_t dl_mph_hash(uint32_t seed, const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	uint32_t h = 0x811c9dc5 ^ (seed * 0x9e3779b9);
+
+	while (*s) {
+		h ^= *s++;
+		h *= 0x01000193;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
 #endif
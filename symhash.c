@@ -0,0 +1,227 @@
+/* Global symbol index for the object file loader
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dlrcu.h"
+#include "symhash.h"
+#include "linker_debug.h"
+
+#define SYMHASH_MIN	64
+
+/* name of removed entries, never equal to a real symbol name */
+static const char symhash_deleted[] = "";
+
+static unsigned symhash_size(unsigned nelem)
+{
+	unsigned size = SYMHASH_MIN;
+
+	/* keep the load factor at or below 3/4 */
+	while (size - size / 4 < nelem)
+		size <<= 1;
+	return size;
+}
+
+static struct symhash_table *symhash_alloc(unsigned size)
+{
+	struct symhash_table *t;
+
+	t = calloc(1, sizeof(*t) + (size - 1) * sizeof(t->slots[0]));
+	if (t == NULL) {
+		ERROR("calloc failed!\n");
+		return NULL;
+	}
+	t->mask = size - 1;
+	return t;
+}
+
+/* Fill a free slot, publishing the name last */
+static void symhash_put(struct symhash_table *t, const struct symhash_entry *e)
+{
+	unsigned i = e->hash & t->mask;
+	struct symhash_entry *slot;
+
+	while (t->slots[i].name)
+		i = (i + 1) & t->mask;
+	slot = &t->slots[i];
+	slot->hash = e->hash;
+	slot->value = e->value;
+	slot->owner = e->owner;
+	dl_rcu_assign(slot->name, e->name);
+}
+
+/* Rebuild the table, sized for the live entries, without tombstones.
+ * The old slots are taken from an empty one once around, so that every
+ * probe cluster, even one wrapping past the end, is walked in probe
+ * order and entries sharing a name keep their order.
+ */
+static int symhash_rebuild(struct symhash *h, unsigned nelem)
+{
+	struct symhash_table *old = h->table, *t;
+	unsigned i, k, start = 0;
+
+	t = symhash_alloc(symhash_size(nelem));
+	if (t == NULL)
+		return -1;
+	TRACE("symhash: rebuilt with %u slots\n", t->mask + 1);
+	/* the load factor leaves empty slots */
+	while (old->slots[start].name)
+		start++;
+	for (k = 1; k <= old->mask + 1; k++) {
+		i = (start + k) & old->mask;
+		if (old->slots[i].name && old->slots[i].name != symhash_deleted)
+			symhash_put(t, &old->slots[i]);
+	}
+	dl_rcu_assign(h->table, t);
+	h->used = h->count;
+	dl_defer_free(old);
+	return 0;
+}
+
+int symhash_init(struct symhash *h, unsigned nelem)
+{
+	h->table = symhash_alloc(symhash_size(nelem));
+	h->count = h->used = 0;
+	return h->table ? 0 : -1;
+}
+
+int symhash_insert(struct symhash *h, const char *name, uint32_t hash,
+		unsigned long value, const void *owner)
+{
+	struct symhash_entry e;
+
+	if (symhash_size(h->used + 1) > h->table->mask + 1 &&
+		symhash_rebuild(h, h->count + 1) < 0)
+		return -1;
+
+	e.hash = hash;
+	e.name = name;
+	e.value = value;
+	e.owner = owner;
+	symhash_put(h->table, &e);
+	h->count++;
+	h->used++;
+	return 0;
+}
+
+/* Readers must be inside dl_read_lock() */
+const struct symhash_entry *symhash_lookup(const struct symhash *h,
+		const char *name, uint32_t hash)
+{
+	const struct symhash_table *t = dl_rcu_dereference(h->table);
+	const struct symhash_entry *e;
+	const char *ename;
+	unsigned i;
+
+	if (t == NULL)
+		return NULL;
+	for (i = hash & t->mask; ; i = (i + 1) & t->mask) {
+		e = &t->slots[i];
+		ename = dl_rcu_dereference(e->name);
+		if (ename == NULL)
+			return NULL;
+		if (e->hash == hash && !strcmp(ename, name))
+			return e;
+	}
+}
+
+/* Remove the entry for name defined by owner, leaving a tombstone so
+ * that concurrent probes still find the entries behind it.
+ */
+void symhash_remove(struct symhash *h, const char *name, uint32_t hash,
+		const void *owner)
+{
+	struct symhash_table *t = h->table;
+	struct symhash_entry *e;
+	unsigned i;
+
+	for (i = hash & t->mask; t->slots[i].name; i = (i + 1) & t->mask) {
+		e = &t->slots[i];
+		if (e->hash == hash && e->owner == owner &&
+			e->name != symhash_deleted && !strcmp(e->name, name)) {
+			dl_rcu_assign(e->name, symhash_deleted);
+			h->count--;
+			break;
+		}
+	}
+
+	/* purge tombstones once they make up half of the used slots */
+	if (h->used - h->count > h->used / 2 && h->used > SYMHASH_MIN / 2)
+		symhash_rebuild(h, h->count);
+}
+
+/* Build the export table of a module from its global definitions */
+struct dl_exports *exports_build(const struct dl_export_def *defs, unsigned n)
+{
+	struct dl_exports *ex;
+	unsigned i, b, nbuckets = 1;
+	size_t strsize = 0, size;
+	uint32_t *fill;
+	char *q;
+
+	while (nbuckets < n)
+		nbuckets <<= 1;
+	for (i = 0; i < n; i++)
+		strsize += strlen(defs[i].name) + 1;
+
+	size = sizeof(*ex) + n * sizeof(unsigned long) +
+		(nbuckets + 1 + 2 * n) * sizeof(uint32_t) + strsize;
+	ex = calloc(1, size);
+	if (ex == NULL) {
+		ERROR("calloc failed!\n");
+		return NULL;
+	}
+	ex->nsyms = n;
+	ex->mask = nbuckets - 1;
+	ex->size = size;
+	ex->values = (unsigned long *)(ex + 1);
+	ex->start = (uint32_t *)(ex->values + n);
+	ex->hashes = ex->start + nbuckets + 1;
+	ex->names = ex->hashes + n;
+	ex->strings = (char *)(ex->names + n);
+
+	/* counting sort by bucket; filling advances start[b] to the end of
+	 * bucket b, shifting the array up by one restores the starts */
+	for (i = 0; i < n; i++)
+		ex->start[(defs[i].hash & ex->mask) + 1]++;
+	for (b = 0; b < nbuckets; b++)
+		ex->start[b + 1] += ex->start[b];
+	fill = ex->start;
+	q = ex->strings;
+	for (i = 0; i < n; i++) {
+		unsigned j = fill[defs[i].hash & ex->mask]++;
+
+		ex->hashes[j] = defs[i].hash;
+		ex->values[j] = defs[i].value;
+		ex->names[j] = q - ex->strings;
+		strcpy(q, defs[i].name);
+		q += strlen(q) + 1;
+	}
+	for (b = nbuckets; b > 0; b--)
+		ex->start[b] = ex->start[b - 1];
+	ex->start[0] = 0;
+
+	TRACE("exports: %u symbols, %u buckets, %lu bytes\n",
+		n, nbuckets, (unsigned long)size);
+	return ex;
+}
+
+/* The index of name in ex, or -1 */
+int exports_find(const struct dl_exports *ex, const char *name, uint32_t hash)
+{
+	unsigned i, b = hash & ex->mask;
+
+	for (i = ex->start[b]; i < ex->start[b + 1]; i++) {
+		if (ex->hashes[i] == hash && !strcmp(dl_export_name(ex, i), name))
+			return i;
+	}
+	return -1;
+}
+
+unsigned long exports_lookup(const struct dl_exports *ex,
+		const char *name, uint32_t hash)
+{
+	int i = exports_find(ex, name, hash);
+
+	return i < 0 ? 0 : ex->values[i];
+}
@@ -0,0 +1,91 @@
+/* Global symbol index for the object file loader
+ */
+#ifndef _LINKER_SYMHASH_H_
+#define _LINKER_SYMHASH_H_
+
+#include <stdint.h>
+
+/* The GNU hash function (Bernstein's h * 33 + c), as used by .gnu.hash */
+static inline uint32_t dl_gnu_hash(const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	uint32_t h = 5381;
+
+	while (*s)
+		h = (h << 5) + h + *s++;
+	return h;
+}
+
+/* Global symbol index: an open addressed (linear probing) hash table.
+ * The hash of every name is cached in its slot, so a probe only calls
+ * strcmp() when the full 32 bit hash matches.  Several entries may share
+ * a name; lookups find the one inserted first, like the old linear search
+ * over the system symbols followed by the modules in load order did.
+ *
+ * Lookups may run concurrently with one writer (see dlrcu.h): an entry
+ * is filled in before its name is published, removal only replaces the
+ * name with a tombstone and slots are never reused in place.  Growing or
+ * purging tombstones builds a new table which replaces the old one with
+ * a single pointer store; the old table is reclaimed through dl_defer().
+ */
+struct symhash_entry
+{
+	uint32_t hash;
+	const char *name;
+	unsigned long value;
+	const void *owner;	/* defining soinfo, NULL for system symbols */
+};
+
+struct symhash_table
+{
+	unsigned mask;		/* number of slots - 1 */
+	struct symhash_entry slots[1];
+};
+
+struct symhash
+{
+	struct symhash_table *table;
+	unsigned count;		/* live entries */
+	unsigned used;		/* live entries and tombstones */
+};
+
+int symhash_init(struct symhash *h, unsigned nelem);
+int symhash_insert(struct symhash *h, const char *name, uint32_t hash,
+		unsigned long value, const void *owner);
+const struct symhash_entry *symhash_lookup(const struct symhash *h,
+		const char *name, uint32_t hash);
+void symhash_remove(struct symhash *h, const char *name, uint32_t hash,
+		const void *owner);
+
+/* Per-module export table.  Everything lives in one allocation: the
+ * header, the values, a bucket start array, the cached hashes, name
+ * offsets and the packed names.  Entries are sorted by bucket, so bucket
+ * b covers entries start[b] .. start[b + 1] - 1.
+ */
+struct dl_exports
+{
+	unsigned nsyms;
+	unsigned mask;		/* number of buckets - 1 */
+	unsigned long *values;
+	uint32_t *start;
+	uint32_t *hashes;
+	uint32_t *names;	/* offsets into strings */
+	char *strings;
+	size_t size;		/* of the whole allocation */
+};
+
+struct dl_export_def
+{
+	const char *name;
+	uint32_t hash;
+	unsigned long value;
+};
+
+#define dl_export_name(ex, i)	((ex)->strings + (ex)->names[i])
+
+struct dl_exports *exports_build(const struct dl_export_def *defs, unsigned n);
+int exports_find(const struct dl_exports *ex, const char *name, uint32_t hash);
+unsigned long exports_lookup(const struct dl_exports *ex,
+		const char *name, uint32_t hash);
+
+#endif
@@ -0,0 +1,156 @@
+/* Binary system symbol map, see sysmap.h for the file layout
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "linker.h"
+#include "sym.h"
+#include "sysmap.h"
+#include "linker_debug.h"
+
+#ifdef DL_USE_MMAP
+#include <sys/mman.h>
+#endif
+
+static const void *sysmap_read(int fd, size_t size, int *mapped)
+{
+	char *buf;
+	size_t done;
+	ssize_t cnt;
+
+#ifdef DL_USE_MMAP
+	buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf != MAP_FAILED) {
+		*mapped = 1;
+		return buf;
+	}
+#endif
+	buf = malloc(size);
+	if (buf == NULL) {
+		ERROR("malloc failed!\n");
+		return NULL;
+	}
+	for (done = 0; done < size; done += cnt) {
+		cnt = read(fd, buf + done, size - done);
+		if (cnt <= 0) {
+			ERROR("read failed!\n");
+			free(buf);
+			return NULL;
+		}
+	}
+	*mapped = 0;
+	return buf;
+}
+
+static void sysmap_close(struct sysmap *map)
+{
+#ifdef DL_USE_MMAP
+	if (map->mapped)
+		munmap((void *)map->hdr, map->size);
+	else
+#endif
+		free((void *)map->hdr);
+	map->hdr = NULL;
+}
+
+/* Open a binary symbol map.
+ *
+ * Returns:
+ *       0 on success
+ *      -1 if the file does not exist or is not a valid map; the caller
+ *         falls back to the text map then.
+ */
+int sysmap_open(const char *filename, struct sysmap *map)
+{
+	const struct sysmap_header *hdr;
+	struct stat filestat;
+	uint64_t need;
+	unsigned i;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &filestat) < 0 ||
+		filestat.st_size < (off_t)sizeof(struct sysmap_header)) {
+		ERROR("%s: not a symbol map\n", filename);
+		close(fd);
+		return -1;
+	}
+	map->size = filestat.st_size;
+	hdr = map->hdr = sysmap_read(fd, map->size, &map->mapped);
+	close(fd);
+	if (hdr == NULL)
+		return -1;
+
+	if (hdr->magic != SYSMAP_MAGIC || hdr->version != SYSMAP_VERSION) {
+		ERROR("%s: bad magic or version (wrong byte order?)\n", filename);
+		goto fail;
+	}
+	need = sizeof(*hdr) + (uint64_t)hdr->nsyms * sizeof(struct sysmap_sym) +
+		((uint64_t)hdr->nbuckets + 1) * sizeof(uint32_t) + hdr->strsize;
+	if (hdr->nbuckets == 0 || (hdr->nbuckets & (hdr->nbuckets - 1)) ||
+		need > map->size || hdr->strsize == 0) {
+		ERROR("%s: truncated or corrupt symbol map\n", filename);
+		goto fail;
+	}
+	map->syms = (const struct sysmap_sym *)(hdr + 1);
+	map->start = (const uint32_t *)(map->syms + hdr->nsyms);
+	map->strings = (const char *)(map->start + hdr->nbuckets + 1);
+	if (map->start[hdr->nbuckets] != hdr->nsyms ||
+		map->strings[hdr->strsize - 1] != '\0') {
+		ERROR("%s: corrupt symbol map\n", filename);
+		goto fail;
+	}
+	for (i = 0; i < hdr->nbuckets; i++) {
+		if (map->start[i] > map->start[i + 1]) {
+			ERROR("%s: corrupt symbol map\n", filename);
+			goto fail;
+		}
+	}
+
+	TRACE("%s: %u system symbols, %u buckets\n", filename,
+		hdr->nsyms, hdr->nbuckets);
+	return 0;
+
+fail:
+	sysmap_close(map);
+	return -1;
+}
+
+unsigned long sysmap_lookup(const struct sysmap *map,
+		const char *name, uint32_t hash)
+{
+	unsigned i, b = hash & (map->hdr->nbuckets - 1);
+	const struct sysmap_sym *sym;
+
+	for (i = map->start[b]; i < map->start[b + 1]; i++) {
+		sym = &map->syms[i];
+		if (sym->hash == hash && sym->name < map->hdr->strsize &&
+			!strcmp(map->strings + sym->name, name))
+			return (unsigned long)sym->value;
+	}
+	return 0;
+}
+
+/* Probe a compiled in minimal perfect hash table, see sym.h */
+unsigned long sysmph_lookup(const struct dl_mph_table *t,
+		const char *name, uint32_t hash)
+{
+	int32_t d;
+	uint32_t slot;
+
+	if (t->nsyms == 0)
+		return 0;
+	d = t->disp[hash % t->nbuckets];
+	if (d == 0)
+		return 0;
+	slot = d < 0 ? (uint32_t)(-d - 1) : dl_mph_hash(d, name) % t->nsyms;
+	if (slot >= t->nsyms || strcmp(t->names + t->syms[slot].name, name))
+		return 0;
+	return t->syms[slot].value;
+}
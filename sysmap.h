@@ -0,0 +1,59 @@
+/* Binary system symbol map
+ *
+ * A sysmap file is generated from 'nm -P' output by tools/mksymmap and
+ * is used in place by the loader: mapped (or read) in one piece, with no
+ * per-symbol allocation or parsing.  All fields are in target byte order.
+ *
+ *   struct sysmap_header
+ *   struct sysmap_sym    syms[nsyms]        sorted by hash bucket
+ *   uint32_t             start[nbuckets + 1]
+ *   char                 strings[strsize]
+ *
+ * Bucket b (hash & (nbuckets - 1)) covers syms[start[b]] up to, but not
+ * including, syms[start[b + 1]].  Hashes are dl_gnu_hash() values.
+ */
+#ifndef _LINKER_SYSMAP_H_
+#define _LINKER_SYSMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYSMAP_MAGIC	0x4c44534dU	/* "LDSM" */
+#define SYSMAP_VERSION	1
+
+struct sysmap_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nsyms;
+	uint32_t nbuckets;	/* a power of two */
+	uint32_t strsize;
+	uint32_t pad;
+};
+
+struct sysmap_sym
+{
+	uint32_t hash;
+	uint32_t name;		/* offset into strings */
+	uint64_t value;
+};
+
+struct sysmap
+{
+	const struct sysmap_header *hdr;
+	const struct sysmap_sym *syms;
+	const uint32_t *start;
+	const char *strings;
+	size_t size;
+	int mapped;
+};
+
+int sysmap_open(const char *filename, struct sysmap *map);
+unsigned long sysmap_lookup(const struct sysmap *map,
+		const char *name, uint32_t hash);
+
+struct dl_mph_table;
+unsigned long sysmph_lookup(const struct dl_mph_table *t,
+		const char *name, uint32_t hash);
+
+#endif
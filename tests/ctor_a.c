@@ -0,0 +1,24 @@
+/* Opens ctor_b.o from its constructor and closes it again from its
+ * destructor, both with the loader busy with this module.
+ */
+#include "../dlfcn.h"
+
+extern int ctor_value;
+
+static void *b;
+
+static void __attribute__((constructor)) open_b(void)
+{
+	int *value;
+
+	b = dlopen("tests/ctor_b.o", RTLD_NOW);
+	value = b ? dlsym(b, "b_value") : 0;
+	ctor_value = value ? *value : -1;
+}
+
+static void __attribute__((destructor)) close_b(void)
+{
+	if (b)
+		dlclose(b);
+	ctor_value = 0;
+}
@@ -0,0 +1 @@
+int b_value = 42;
@@ -0,0 +1,33 @@
+/* Constructors and destructors run without the loader lock, so they may
+ * load and unload modules themselves.
+ */
+#include <stdio.h>
+
+#include "../dlfcn.h"
+
+int ctor_value;
+
+int main(void)
+{
+	void *a, *b;
+	int failed = 0;
+
+	a = dlopen("tests/ctor_a.o", RTLD_NOW);
+	if (a == NULL || ctor_value != 42) {
+		fprintf(stderr, "ctor_test: constructor did not load ctor_b.o\n");
+		return 1;
+	}
+	/* one reference from the constructor, one of ours */
+	b = dlopen("tests/ctor_b.o", RTLD_NOW);
+	if (b == NULL || dlsym(b, "b_value") == NULL)
+		failed = 1;
+	dlclose(b);
+	dlclose(a);
+	if (ctor_value != 0) {
+		fprintf(stderr, "ctor_test: destructor did not run\n");
+		failed = 1;
+	}
+	if (!failed)
+		printf("ctor_test: ok\n");
+	return failed;
+}
@@ -0,0 +1,58 @@
+/* The merge pool shares equal contents, keeps them aligned as asked for
+ * and packs the entries of a module next to each other.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "../dlmerge.h"
+
+int debug_verbosity;
+
+static int failed;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed = 1; \
+	} \
+} while (0)
+
+int main(void)
+{
+	static const char big[20000];
+	struct dl_merge_entry *a, *b, *c, *d, *e;
+	static const double one = 1.0;
+
+	if (dl_merge_init() < 0)
+		return 1;
+	a = dl_merge_get("hello\n", 7, 1);
+	b = dl_merge_get("world\n", 7, 1);
+	c = dl_merge_get("hello\n", 7, 1);
+	CHECK(a && b && c);
+	CHECK(a == c && a->refs == 2);
+	CHECK(!strcmp(a->data, "hello\n"));
+	/* short strings lie next to each other */
+	CHECK(b->data == a->data + 7);
+
+	d = dl_merge_get(&one, sizeof(one), 16);
+	CHECK(d && ((unsigned long)d->data & 15) == 0);
+	CHECK(d && !memcmp(d->data, &one, sizeof(one)));
+
+	/* more than a chunk holds */
+	e = dl_merge_get(big, sizeof(big), 1);
+	CHECK(e && e->chunk != a->chunk && !memcmp(e->data, big, sizeof(big)));
+	dl_merge_put(e);
+	/* and small ones go on in the chunk they were in */
+	e = dl_merge_get("again", 6, 1);
+	CHECK(e && e->chunk == a->chunk);
+
+	dl_merge_put(c);
+	CHECK(a->refs == 1);
+	dl_merge_put(a);
+	a = dl_merge_get("hello\n", 7, 1);
+	CHECK(a && a->refs == 1 && !strcmp(a->data, "hello\n"));
+
+	if (!failed)
+		printf("dlmerge_test: ok\n");
+	return failed;
+}
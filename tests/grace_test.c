@@ -0,0 +1,48 @@
+/* A grace period ends once every thread reporting quiescent states has
+ * reported one since it began; other threads are not waited for.
+ */
+#include <pthread.h>
+#include <stdio.h>
+
+#include "../dlrcu.h"
+
+int debug_verbosity;
+
+static int failed;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed = 1; \
+	} \
+} while (0)
+
+static void *report(void *arg)
+{
+	dl_quiescent();
+	return arg;
+}
+
+int main(void)
+{
+	unsigned long e;
+	pthread_t t;
+
+	dl_rcu_init();
+	/* nobody reports yet */
+	e = dl_grace_begin();
+	CHECK(dl_grace_over(e));
+
+	dl_quiescent();
+	/* a thread that reported and exited is not waited for */
+	pthread_create(&t, NULL, report, NULL);
+	pthread_join(t, NULL);
+	e = dl_grace_begin();
+	CHECK(!dl_grace_over(e));
+	dl_quiescent();
+	CHECK(dl_grace_over(e));
+
+	if (!failed)
+		printf("grace_test: ok\n");
+	return failed;
+}
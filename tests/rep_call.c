@@ -0,0 +1,7 @@
+/* Bound to a function of rep_v1.o, through its trampoline */
+extern int rep_version(void);
+
+int call_user(void)
+{
+	return rep_version();
+}
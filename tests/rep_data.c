@@ -0,0 +1,7 @@
+/* Bound to the data of rep_v1.o */
+extern int rep_data;
+
+int data_user(void)
+{
+	return rep_data;
+}
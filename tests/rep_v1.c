@@ -0,0 +1,6 @@
+int rep_data = 1;
+
+int rep_version(void)
+{
+	return 1;
+}
@@ -0,0 +1,6 @@
+int rep_data = 2;
+
+int rep_version(void)
+{
+	return 2;
+}
@@ -0,0 +1,48 @@
+/* dlreplace() refuses a module whose data another module is bound to,
+ * and sends the calls of the others to the new version.
+ */
+#include <stdio.h>
+
+#include "../dlfcn.h"
+
+static int failed;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed = 1; \
+	} \
+} while (0)
+
+int main(void)
+{
+	void *v1, *v2, *data, *call;
+	int (*call_user)(void);
+
+	dlquiescent();
+	v1 = dlopen("tests/rep_v1.o", RTLD_NOW | RTLD_REPLACEABLE);
+	data = dlopen("tests/rep_data.o", RTLD_NOW);
+	call = dlopen("tests/rep_call.o", RTLD_NOW);
+	CHECK(v1 && data && call);
+	if (failed)
+		return failed;
+	call_user = (int (*)(void))dlsym(call, "call_user");
+	CHECK(call_user && call_user() == 1);
+
+	/* rep_data.o would keep reading the old rep_data */
+	CHECK(dlreplace(v1, "tests/rep_v2.o") == NULL);
+	CHECK(call_user() == 1);
+
+	dlclose(data);
+	v2 = dlreplace(v1, "tests/rep_v2.o");
+	CHECK(v2 != NULL);
+	CHECK(call_user() == 2);
+	/* the old version goes with this thread's report */
+	dlquiescent();
+
+	dlclose(call);
+	dlclose(v2);
+	if (!failed)
+		printf("replace_test: ok\n");
+	return failed;
+}
@@ -0,0 +1,75 @@
+/* Duplicate names in symhash keep their order across rebuilds, also
+ * when their probe cluster wraps past the end of the table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../dlrcu.h"
+#include "../symhash.h"
+
+int debug_verbosity;
+
+static int failed;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed = 1; \
+	} \
+} while (0)
+
+static unsigned long value_of(struct symhash *h, const char *name, uint32_t hash)
+{
+	const struct symhash_entry *e = symhash_lookup(h, name, hash);
+
+	return e ? e->value : 0;
+}
+
+int main(void)
+{
+	static char names[64][8];
+	struct symhash h;
+	uint32_t last;
+	unsigned i;
+
+	dl_rcu_init();
+	if (symhash_init(&h, 0) < 0)
+		return 1;
+	last = h.table->mask;
+
+	/* "dup" twice from the last slot: the first copy is there, the
+	 * second wraps around to slot 0
+	 */
+	symhash_insert(&h, "dup", last, 1, NULL);
+	symhash_insert(&h, "dup", last, 2, NULL);
+	CHECK(h.table->slots[0].value == 2);
+	CHECK(value_of(&h, "dup", last) == 1);
+
+	/* grow */
+	for (i = 0; i < 64; i++) {
+		snprintf(names[i], sizeof(names[i]), "s%u", i);
+		symhash_insert(&h, names[i], i * 7, 100 + i, NULL);
+	}
+	CHECK(h.table->mask > last);
+	CHECK(value_of(&h, "dup", last) == 1);
+	for (i = 0; i < 64; i++)
+		CHECK(value_of(&h, names[i], i * 7) == 100 + i);
+
+	/* purge the tombstones, back to a table where "dup" wraps */
+	for (i = 0; i < 64; i++)
+		symhash_remove(&h, names[i], i * 7, NULL);
+	CHECK(h.table->mask == last);
+	CHECK(value_of(&h, "dup", last) == 1);
+	/* and purge in a table of that size */
+	for (i = 0; i < 40; i++)
+		symhash_insert(&h, names[i], i * 7, 100 + i, NULL);
+	for (i = 0; i < 40; i++)
+		symhash_remove(&h, names[i], i * 7, NULL);
+	CHECK(value_of(&h, "dup", last) == 1);
+	symhash_remove(&h, "dup", last, NULL);
+	CHECK(value_of(&h, "dup", last) == 2);
+
+	if (!failed)
+		printf("symhash_test: ok\n");
+	return failed;
+}
@@ -72,6 +72,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "../mph.h"
+
 /*
  * some debugging flags are actually 'verbosity' flags
  * and are also used if DEBUG is undefined
@@ -1770,9 +1772,31 @@ const char *sname = ps->name;
 	return sname;
 }
 
+/* symbol table entries collected by writeSymdefs() pass 1 */
+static char		**srcNames   = 0;
+static char		**srcValues  = 0;
+static unsigned	srcCount     = 0;
+
+static void
+addSrcSym(const char *name, const char *title, int i)
+{
+char buf[200];
+	if ( !(srcCount & 1023) ) {
+		srcNames  = realloc(srcNames,  (srcCount + 1024) * sizeof(*srcNames));
+		srcValues = realloc(srcValues, (srcCount + 1024) * sizeof(*srcValues));
+		assert( srcNames && srcValues );
+	}
+	snprintf(buf, sizeof(buf), "&"DUMMY_ALIAS_PREFIX"%s%i", title, i);
+	srcNames[srcCount]  = strdup(name);
+	srcValues[srcCount] = strdup(buf);
+	srcCount++;
+}
+
 /*
  * Write symbol definitions in C source form for all members of a link set
  * to 'feil'. A 'title' may be added as a C-style comment.
+ * Pass 0 declares the symbols, pass 1 collects the table entries which
+ * writeSource() then emits as a perfect hash table.
  *
  * The output is suitable for building into CEXP applications
  */
@@ -1786,10 +1810,10 @@ int     i;
 	if ( !f )
 		return 0;
 
+if ( 0 == pass ) {
 	if (title)
 		fprintf(feil,"/* ----- %s Link Set ----- */\n\n", title);
 
-if ( 0 == pass ) {
 	for ( i=0 ; f; f = f->link.next ) {
 		fprintf(feil,"/* "); printObjName(feil,f); fprintf(feil,": */\n");
 		for ( n = 0; n < f->nexports; n++ ) {
@@ -1803,26 +1827,8 @@ if ( 0 == pass ) {
 	}
 } else {
 	for ( i=0 ; f; f = f->link.next ) {
-		fprintf(feil,"/* "); printObjName(feil,f); fprintf(feil,": */\n");
 		for ( n = 0; n < f->nexports; n++ ) {
-			Sym  s      = f->exports[n].sym;
-			const char *sname = getsname(s,0);
-			char t      = TYPE(s);
-			char ut     = toupper(t);
-			fprintf(feil,"\t{\n");
-			fprintf(feil,"\t\t.name        = \"%s\",\n", sname);
-			fprintf(feil,"\t\t.value   =(unsigned long)&"DUMMY_ALIAS_PREFIX"%s%i,\n",title,i);
-			/*fprintf(feil,"\t\t.value.ptv   =(void*)&"DUMMY_ALIAS_PREFIX"%s%i,\n",title,i);
-			fprintf(feil,"\t\t.value.type  =%s,\n",      'T'==t ? "TFuncP" : "TVoid");
-			fprintf(feil,"\t\t.size        =%i,\n",      s->size);
-			fprintf(feil,"\t\t.flags       =0");
-				if ( isupper(t) )
-					fprintf(feil,"|CEXP_SYMFLG_GLBL");
-				if ( ( 'W' == ut || 'V' == ut ) &&
-				     strcmp("cexpSystemSymbols",sname) )
-					fprintf(feil,"|CEXP_SYMFLG_WEAK");
-			fprintf(feil,",\n");*/
-			fprintf(feil,"\t},\n");
+			addSrcSym(getsname(f->exports[n].sym,0), title, i);
 			i++;
 		}
 	}
@@ -1842,23 +1848,15 @@ int pass;
 	for ( pass = 0; pass < 2; pass++ ) {
 		if ( 0== pass )
 			fprintf(feil,"#include \"sym.h\"\n");
-		else
-			fprintf(feil,"\n\nstatic struct dl_symbol systemSymbols[] = {\n");
 		if ( !optionalOnly ) {
 			writeSymdefs(feil, &appLinkSet, "Application", pass);
-			fputc('\n',feil);
+			if ( 0 == pass )
+				fputc('\n',feil);
 		}
 
 		writeSymdefs(feil, &optionalLinkSet, "Optional", pass);
-		if ( 1 == pass ) {
-			fprintf(feil,"\t{\n");
-			fprintf(feil,"\t0, /* terminating record */\n");
-			fprintf(feil,"\t},\n");
-			fprintf(feil,"};\n");
-			fprintf(feil,"struct dl_symbl *cexpSystemSymbols = systemSymbols;\n");
-		}
-}
-	return 0;
+	}
+	return mph_write(feil, srcNames, srcValues, srcCount);
 }
 
 
@@ -0,0 +1,197 @@
+/* Generate a binary system symbol map (see sysmap.h) from the output of
+ * 'nm -P' (or 'nm -g -fposix'), i.e. lines of the form
+ *
+ *	<symbol_name> <class_char> <value> [<size>]
+ *
+ * Undefined symbols are skipped, and of several definitions of the same
+ * name the first one is kept.  The map is written in host byte order
+ * unless -B (big endian) or -L (little endian) is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../symhash.h"
+#include "../sysmap.h"
+
+#define ONCEMORE 1024
+
+struct symrec {
+	char *name;
+	uint32_t hash;
+	uint64_t value;
+};
+
+static int swap;
+
+static uint32_t out32(uint32_t v)
+{
+	if (!swap)
+		return v;
+	return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+static uint64_t out64(uint64_t v)
+{
+	if (!swap)
+		return v;
+	return ((uint64_t)out32((uint32_t)v) << 32) | out32((uint32_t)(v >> 32));
+}
+
+static void
+usage(char *nm)
+{
+	fprintf(stderr, "Usage: %s [-B|-L] [-o map_file] [nm_file]\n", nm);
+	fprintf(stderr, "   Convert 'nm -P' output (stdin if no nm_file) into a binary\n");
+	fprintf(stderr, "   symbol map for the object file loader (default: sym.map).\n");
+	fprintf(stderr, "     -B:   write a big endian map\n");
+	fprintf(stderr, "     -L:   write a little endian map\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int ch, i, j, b, vecsize, count = 0, kept, bigendian = -1;
+	unsigned nbuckets = 1;
+	uint32_t strsize = 0, *start, *order, off;
+	const char *outname = "sym.map";
+	FILE *fout, *fin = stdin;
+	char buf[BUFSIZ/2], otype, *rest;
+	unsigned long long val;
+	struct symrec *vec;
+	struct sysmap_header hdr;
+	struct sysmap_sym sym;
+	union { uint32_t w; unsigned char c[4]; } probe = { 1 };
+
+	while ((ch = getopt(argc, argv, "BLo:h")) >= 0) {
+		switch (ch) {
+		case 'B': bigendian = 1; break;
+		case 'L': bigendian = 0; break;
+		case 'o': outname = optarg; break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (bigendian >= 0)
+		swap = bigendian == probe.c[0];
+
+	if (optind < argc) {
+		fin = fopen(argv[optind], "r");
+		if (!fin) {
+			perror("opening nm file");
+			return -1;
+		}
+	}
+
+	vec = malloc(ONCEMORE*sizeof(struct symrec));
+	if (!vec) {
+		printf("no memory\n");
+		return -1;
+	}
+	vecsize = ONCEMORE;
+
+	while (fgets(buf, sizeof(buf), fin)) {
+		for (rest = buf; *rest && !isspace((unsigned char)*rest); ++rest)
+			;
+		if (!*rest || rest == buf)
+			continue;
+		*rest++ = 0;
+		if (sscanf(rest, " %c %llx", &otype, &val) != 2)
+			continue;
+		if (toupper((unsigned char)otype) == 'U')
+			continue;
+		if (count == vecsize) {
+			vecsize += ONCEMORE;
+			vec = realloc(vec, vecsize*sizeof(struct symrec));
+			if (!vec) {
+				printf("no memory\n");
+				return -1;
+			}
+		}
+		vec[count].name = strdup(buf);
+		vec[count].hash = dl_gnu_hash(buf);
+		vec[count].value = val;
+		count++;
+	}
+	if (fin != stdin)
+		fclose(fin);
+
+	while (nbuckets < (unsigned)count)
+		nbuckets <<= 1;
+	start = calloc(nbuckets + 1, sizeof(uint32_t));
+	order = malloc((count ? count : 1) * sizeof(uint32_t));
+	if (!start || !order) {
+		printf("no memory\n");
+		return -1;
+	}
+
+	/* stable counting sort by bucket, so the first definition of a name
+	 * stays ahead of any later ones */
+	for (i = 0; i < count; i++)
+		start[(vec[i].hash & (nbuckets - 1)) + 1]++;
+	for (b = 0; b < (int)nbuckets; b++)
+		start[b + 1] += start[b];
+	for (i = 0; i < count; i++)
+		order[start[vec[i].hash & (nbuckets - 1)]++] = i;
+
+	/* drop duplicates within each bucket and rebuild start[] */
+	kept = 0;
+	for (b = 0, i = 0; b < (int)nbuckets; b++) {
+		int end = start[b];
+
+		start[b] = kept;
+		for (; i < end; i++) {
+			for (j = start[b]; j < kept; j++) {
+				if (vec[order[j]].hash == vec[order[i]].hash &&
+					!strcmp(vec[order[j]].name, vec[order[i]].name))
+					break;
+			}
+			if (j < kept)
+				continue;
+			order[kept++] = order[i];
+			strsize += strlen(vec[order[i]].name) + 1;
+		}
+	}
+	start[nbuckets] = kept;
+
+	fout = fopen(outname, "wb");
+	if (!fout) {
+		perror("opening map file");
+		return -1;
+	}
+
+	hdr.magic = out32(SYSMAP_MAGIC);
+	hdr.version = out32(SYSMAP_VERSION);
+	hdr.nsyms = out32(kept);
+	hdr.nbuckets = out32(nbuckets);
+	hdr.strsize = out32(strsize ? strsize : 1);
+	hdr.pad = 0;
+	fwrite(&hdr, sizeof(hdr), 1, fout);
+
+	off = 0;
+	for (i = 0; i < kept; i++) {
+		sym.hash = out32(vec[order[i]].hash);
+		sym.name = out32(off);
+		sym.value = out64(vec[order[i]].value);
+		fwrite(&sym, sizeof(sym), 1, fout);
+		off += strlen(vec[order[i]].name) + 1;
+	}
+	for (b = 0; b <= (int)nbuckets; b++) {
+		off = out32(start[b]);
+		fwrite(&off, sizeof(off), 1, fout);
+	}
+	for (i = 0; i < kept; i++)
+		fwrite(vec[order[i]].name, strlen(vec[order[i]].name) + 1, 1, fout);
+	if (!strsize)
+		fputc(0, fout);
+
+	if (fclose(fout)) {
+		perror("writing map file");
+		return -1;
+	}
+	return 0;
+}
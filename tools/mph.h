@@ -0,0 +1,170 @@
+/* Minimal perfect hash construction for the generated system symbol
+ * tables, shared by mydeps and ldep.  See struct dl_mph_table in sym.h
+ * for the layout and the lookup the loader does.
+ *
+ * Hash and displace: names are spread over nsyms / 4 buckets by their
+ * GNU hash.  Buckets are placed largest first, each searching for a
+ * displacement d that sends all of its names to distinct free slots.
+ * Single name buckets just take the next free slot, stored as -slot - 1.
+ */
+#ifndef _TOOLS_MPH_H_
+#define _TOOLS_MPH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sym.h"
+#include "../symhash.h"
+
+#define MPH_MAXDISP	(1 << 24)
+
+struct mph_bucket {
+	unsigned index;
+	unsigned count;
+	unsigned first;		/* into the bucket sorted key order */
+};
+
+static int
+mph_cmp_bucket(const void *a, const void *b)
+{
+	const struct mph_bucket *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Compute disp[nbuckets] and slot[n] (the slot of each name).
+ * Returns the number of buckets, or 0 on failure.
+ */
+static unsigned
+mph_build(char **names, unsigned n, int32_t **pdisp, unsigned **pslot)
+{
+	unsigned nbuckets = n / 4 + 1, i, j, k, d, s;
+	struct mph_bucket *bkt;
+	unsigned *keys, *slot, *tried;
+	char *used;
+	int32_t *disp;
+
+	bkt = calloc(nbuckets, sizeof(*bkt));
+	keys = malloc((n + 1) * sizeof(*keys));
+	slot = malloc((n + 1) * sizeof(*slot));
+	tried = malloc((n + 1) * sizeof(*tried));
+	used = calloc(n + 1, 1);
+	disp = calloc(nbuckets, sizeof(*disp));
+	if (!bkt || !keys || !slot || !tried || !used || !disp) {
+		fprintf(stderr, "no memory\n");
+		return 0;
+	}
+
+	for (i = 0; i < nbuckets; i++)
+		bkt[i].index = i;
+	for (i = 0; i < n; i++)
+		bkt[dl_gnu_hash(names[i]) % nbuckets].count++;
+	for (i = 0, k = 0; i < nbuckets; i++) {
+		bkt[i].first = k;
+		k += bkt[i].count;
+		bkt[i].count = 0;
+	}
+	for (i = 0; i < n; i++) {
+		struct mph_bucket *b = &bkt[dl_gnu_hash(names[i]) % nbuckets];
+		keys[b->first + b->count++] = i;
+	}
+	qsort(bkt, nbuckets, sizeof(*bkt), mph_cmp_bucket);
+
+	for (i = 0, s = 0; i < nbuckets && bkt[i].count > 1; i++) {
+		for (d = 1; d < MPH_MAXDISP; d++) {
+			for (j = 0; j < bkt[i].count; j++) {
+				tried[j] = dl_mph_hash(d, names[keys[bkt[i].first + j]]) % n;
+				if (used[tried[j]])
+					break;
+				used[tried[j]] = 1;
+			}
+			if (j == bkt[i].count)
+				break;
+			while (j-- > 0)
+				used[tried[j]] = 0;
+		}
+		if (d == MPH_MAXDISP) {
+			fprintf(stderr, "no perfect hash found (duplicate symbol '%s'?)\n",
+				names[keys[bkt[i].first]]);
+			return 0;
+		}
+		disp[bkt[i].index] = d;
+		for (j = 0; j < bkt[i].count; j++)
+			slot[keys[bkt[i].first + j]] = tried[j];
+	}
+	for (; i < nbuckets && bkt[i].count == 1; i++) {
+		while (used[s])
+			s++;
+		used[s] = 1;
+		disp[bkt[i].index] = -(int32_t)s - 1;
+		slot[keys[bkt[i].first]] = s;
+	}
+
+	free(bkt);
+	free(keys);
+	free(tried);
+	free(used);
+	*pdisp = disp;
+	*pslot = slot;
+	return nbuckets;
+}
+
+/* Emit the tables and cexpSystemSymtab.  values[i] is the C expression
+ * for the address of names[i].
+ */
+static int
+mph_write(FILE *fout, char **names, char **values, unsigned n)
+{
+	unsigned nbuckets, i, *slot, *order, *offset, off;
+	int32_t *disp;
+
+	if (n == 0) {
+		fprintf(fout,"\nstatic const int32_t systemSymbolDisp[1];\n");
+		fprintf(fout,"const struct dl_mph_table cexpSystemSymtab = {\n");
+		fprintf(fout,"\t0, 1, systemSymbolDisp, 0, \"\",\n};\n");
+		return 0;
+	}
+
+	nbuckets = mph_build(names, n, &disp, &slot);
+	order = malloc(n * sizeof(*order));
+	offset = malloc(n * sizeof(*offset));
+	if (!nbuckets || !order || !offset)
+		return -1;
+	for (i = 0, off = 0; i < n; i++) {
+		order[slot[i]] = i;
+		offset[i] = off;
+		off += strlen(names[i]) + 1;
+	}
+
+	fprintf(fout,"\nstatic const char systemSymbolNames[] =\n");
+	for (i = 0; i < n; i++)
+		fprintf(fout,"\t\"%s\\0\"\n", names[i]);
+	fprintf(fout,"\t;\n");
+
+	fprintf(fout,"\nstatic const int32_t systemSymbolDisp[%u] = {", nbuckets);
+	for (i = 0; i < nbuckets; i++)
+		fprintf(fout,"%s%d,", i % 8 ? " " : "\n\t", disp[i]);
+	fprintf(fout,"\n};\n");
+
+	fprintf(fout,"\nstatic const struct dl_mph_sym systemSymbolSlots[%u] = {\n", n);
+	for (i = 0; i < n; i++)
+		fprintf(fout,"\t{ %u, (unsigned long)%s },\n",
+			offset[order[i]], values[order[i]]);
+	fprintf(fout,"};\n");
+
+	fprintf(fout,"\nconst struct dl_mph_table cexpSystemSymtab = {\n");
+	fprintf(fout,"\t%u, %u, systemSymbolDisp, systemSymbolSlots, systemSymbolNames,\n",
+		n, nbuckets);
+	fprintf(fout,"};\n");
+
+	free(disp);
+	free(slot);
+	free(order);
+	free(offset);
+	return 0;
+}
+
+#endif
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "mph.h"
+
 #define ONCEMORE 1024
 
 struct namerec {
@@ -49,6 +51,7 @@ main(int argc, char *argv[])
 	int i, vecsize, count = 0;
 	FILE *fout, *fin;
 	char *comment, buf[64];
+	char **names, **values;
 	struct namerec *vec;
 	
 	fin = fopen(argv[1], "r");
@@ -76,7 +79,7 @@ main(int argc, char *argv[])
 
 	while (fgets(buf, sizeof(buf), fin)) {
 
-		if ( !buf[63] ) {
+		if ( !strchr(buf, '\n') && !feof(fin) ) {
 			fprintf(stderr,"Scanner buffer overrun\n");
 			return -1;
 		}
@@ -119,27 +122,38 @@ printf("Scanned '%s'\n",buf); continue;
 			continue;
 
 		fprintf(fout,"extern int %s;\n",buf);
-		vec[count++].name = strdup(buf);
-		if (count > vecsize) {
+		if (count == vecsize) {
 			vecsize += ONCEMORE;
 			vec = realloc(vec, vecsize*sizeof(struct namerec));
+			if (!vec) {
+				printf("no memory\n");
+				return -1;
+			}
 		}
+		vec[count++].name = strdup(buf);
 	}
 
-	fprintf(fout,"\nstatic struct dl_symbol system_symbols[] = {\n");
-
+	names = malloc((count + 1) * sizeof(char *));
+	values = malloc((count + 1) * sizeof(char *));
+	if (!names || !values) {
+		printf("no memory\n");
+		return -1;
+	}
 	for(i = 0; i < count; i++) {
-		fprintf(fout,"\t{\n");
-		fprintf(fout,"\t\t.name   = \"%s\",\n", vec[i].name);
-		fprintf(fout,"\t\t.value  = (unsigned long)&%s,\n", vec[i].name);
-		fprintf(fout,"\t},\n");
+		names[i] = vec[i].name;
+		values[i] = malloc(strlen(vec[i].name) + 2);
+		if (!values[i]) {
+			printf("no memory\n");
+			return -1;
+		}
+		sprintf(values[i], "&%s", vec[i].name);
 	}
+	if (mph_write(fout, names, values, count))
+		return -1;
 
-	fprintf(fout,"\t{\n");
-	fprintf(fout,"\t0, /* terminating record */\n");
-	fprintf(fout,"\t},\n");
-	fprintf(fout,"};\n");
-	fprintf(fout,"struct dl_symbl *cexpSystemSymbols = system_symbols;\n");
-
+	if (fclose(fout)) {
+		perror("writing source file");
+		return -1;
+	}
 	return 0;
 }